@@ -0,0 +1,324 @@
+#include "analyze.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "hash.h"
+#include "main.h"
+#include "movegen.h"
+#include "nnue.h"
+#include "search.h"
+#include "thread.h"
+#include "uci.h"
+#include "util.h"
+
+namespace {
+  struct analysis_limits {
+    int depth{};
+    uint64_t nodes{};
+    int64_t move_time{};
+  };
+
+  struct analysis_batch {
+    std::vector<std::string> lines;
+    analysis_limits limits;
+    std::atomic<size_t> next_line{};
+    std::atomic<size_t> lines_done{};
+    std::atomic<uint64_t> nodes{};
+    std::ofstream out;
+    Mutex out_mutex;
+  };
+
+  class analysisthread final : public thread {
+  public:
+    analysisthread(analysis_batch* batch, int hash_mb);
+    ~analysisthread() override;
+    void begin_search() override;
+    void check_limits();
+  private:
+    std::string analyze_line(const std::string& line);
+    void reset_stats() const;
+    void search_position();
+
+    analysis_batch* batch_;
+    hash hash_;
+    search_signals signals_;
+    cmhinfo* cmhi_;
+    Mutex job_mutex_;
+    bool job_active_ = false;
+    time_point job_start_{};
+  };
+
+  analysisthread::analysisthread(analysis_batch* batch, const int hash_mb)
+    : batch_(batch) {
+    hash_.init(hash_mb);
+    cmhi_ = static_cast<cmhinfo*>(calloc(sizeof(cmhinfo), true));
+    cmhi = cmhi_;
+    hash_table = &hash_;
+    signals = &signals_;
+  }
+
+  analysisthread::~analysisthread() {
+    free(cmhi_);
+  }
+
+  void analysisthread::begin_search() {
+    size_t index;
+    while ((index = batch_->next_line++) < batch_->lines.size()) {
+      const auto result = analyze_line(batch_->lines[index]);
+      {
+        std::lock_guard lk(batch_->out_mutex);
+        batch_->out << result << std::endl;
+      }
+      ++batch_->lines_done;
+    }
+  }
+
+  void analysisthread::check_limits() {
+    std::lock_guard lk(job_mutex_);
+    if (!job_active_) return;
+
+    if (const auto& limits = batch_->limits;
+      limits.move_time && now() - job_start_ >= limits.move_time ||
+      limits.nodes && root_position->visited_nodes() >= limits.nodes)
+      signals_.stop_analyzing = true;
+  }
+
+  void analysisthread::reset_stats() const {
+    std::memset(ti->position_inf, 0, sizeof ti->position_inf);
+    hash_.clear();
+    cmhi_->counter_move_stats.clear();
+    ti->history.clear();
+    ti->evasion_history.clear();
+    ti->max_gain_table.clear();
+    ti->counter_moves.clear();
+    ti->counter_followup_moves.clear();
+    ti->capture_history.clear();
+  }
+
+  std::string analysisthread::analyze_line(const std::string& line) {
+    std::istringstream is(line);
+    std::string fen, token;
+
+    for (auto i = 0; i < 4 && is >> token; ++i) fen += token + " ";
+
+    std::string operations;
+    std::getline(is, operations);
+    operations = trim(operations);
+
+    if (!operations.empty() && isdigit(operations[0])) {
+      std::istringstream counters(operations);
+      std::string half_moves, full_moves;
+      counters >> half_moves >> full_moves;
+      fen += half_moves + " " + full_moves + " ";
+      operations.clear();
+      std::getline(counters, operations);
+      operations = trim(operations);
+    }
+
+    fen = trim(fen);
+    reset_stats();
+    root_position->set(fen, uci_chess960, this);
+
+    root_moves.clear();
+    for (const auto& move : legal_move_list(*root_position))
+      root_moves.add(rootmove(move));
+
+    {
+      std::lock_guard lk(job_mutex_);
+      signals_.stop_analyzing = false;
+      job_start_ = now();
+      job_active_ = true;
+    }
+
+    completed_depth = 0;
+    if (root_moves.move_number)
+      search_position();
+    else {
+      root_moves.add(rootmove(no_move));
+      root_moves[0].score =
+        root_position->is_in_check() ? -mate_score : draw_score;
+    }
+
+    {
+      std::lock_guard lk(job_mutex_);
+      job_active_ = false;
+    }
+
+    batch_->nodes += root_position->visited_nodes();
+
+    std::string kind, value;
+    std::istringstream score(score_cp(root_moves[0].score));
+    score >> kind >> value;
+
+    std::ostringstream ss;
+    ss << fen << " ";
+    if (!operations.empty()) ss << operations << " ";
+    ss << "acd " << completed_depth << "; acn "
+      << root_position->visited_nodes() << "; "
+      << (kind == "cp" ? "ce " : "dm ") << value << ";";
+
+    if (root_moves[0].pv[0] != no_move) {
+      ss << " pv";
+      for (auto i = 0; i < root_moves[0].pv.size(); ++i)
+        ss << " " << move_to_string(root_moves[0].pv[i], *root_position);
+      ss << ";";
+    }
+    return ss.str();
+  }
+
+  void analysisthread::search_position() {
+    constexpr auto delta_margin = 14;
+    constexpr auto delta_add = 4;
+    const auto& limits = batch_->limits;
+
+    init_search_stack();
+    active_pv = 0;
+    auto root_depth = plies / 2;
+
+    for (auto iteration = 1; iteration < 100; ++iteration) {
+      if (limits.depth && iteration > limits.depth) break;
+      root_depth += main_thread_inc;
+
+      for (auto i = 0; i < root_moves.move_number; i++)
+        root_moves[i].previous_score = root_moves[i].score;
+
+      auto delta = delta_margin;
+      auto alpha = -max_score;
+      auto beta = max_score;
+      if (root_depth >= 5 * plies) {
+        alpha = std::max(root_moves[0].previous_score - delta, -max_score);
+        beta = std::min(root_moves[0].previous_score + delta, max_score);
+      }
+
+      while (true) {
+        const auto best_value = search::alpha_beta<search::PV>(
+          *root_position, alpha, beta, root_depth, false);
+
+        std::stable_sort(root_moves.moves,
+          root_moves.moves + root_moves.move_number);
+
+        if (signals_.stop_analyzing) break;
+
+        if (best_value <= alpha) {
+          beta = (alpha + beta) / 2;
+          alpha = std::max(best_value - delta, -max_score);
+        }
+        else if (best_value >= beta) {
+          alpha = (alpha + beta) / 2;
+          beta = std::min(best_value + delta, max_score);
+        }
+        else
+          break;
+
+        delta += delta / 4 + delta_add;
+      }
+
+      if (signals_.stop_analyzing) break;
+      completed_depth = iteration;
+
+      if (constexpr auto mate_depth_add = 10;
+        abs(root_moves[0].score) > mate_score - 32 &&
+        root_depth >=
+        (mate_score - abs(root_moves[0].score) + mate_depth_add) * plies)
+        break;
+    }
+  }
+}
+
+int analyze(std::istringstream& is) {
+  std::string input, output, token;
+  analysis_batch batch;
+  auto workers = static_cast<int>(std::thread::hardware_concurrency());
+  auto hash_mb = 16;
+
+  is >> input >> output;
+  while (is >> token) {
+    if (token == "depth")
+      is >> batch.limits.depth;
+    else if (token == "nodes")
+      is >> batch.limits.nodes;
+    else if (token == "movetime")
+      is >> batch.limits.move_time;
+    else if (token == "workers")
+      is >> workers;
+    else if (token == "hash")
+      is >> hash_mb;
+  }
+  if (!batch.limits.depth && !batch.limits.nodes && !batch.limits.move_time)
+    batch.limits.depth = 10;
+  workers = std::clamp(workers, 1, max_threads);
+  hash_mb = std::max(hash_mb, 1);
+
+  std::ifstream in(input);
+  if (!in) {
+    acout() << "info string analyze: cannot open " << input << std::endl;
+    return fflush(stdout);
+  }
+  for (std::string line; std::getline(in, line);)
+    if (line = trim(line, " \t\r"); !line.empty() && line[0] != '#')
+      batch.lines.push_back(line);
+
+  batch.out.open(output);
+  if (!batch.out) {
+    acout() << "info string analyze: cannot open " << output << std::endl;
+    return fflush(stdout);
+  }
+
+  search::signals.stop_analyzing = true;
+  thread_pool.main()->wake(false);
+  thread_pool.main()->wait_for_search_to_end();
+  nnue_publish();
+
+  thread_pool.analysis_mode = true;
+  thread_pool.piece_contempt = 0;
+  thread_pool.root_contempt_value = score_0;
+  search::draw[white] = search::draw[black] = draw_score;
+
+  workers = std::min(workers, std::max(static_cast<int>(batch.lines.size()), 1));
+  acout() << "info string analyze " << batch.lines.size() << " positions "
+    << workers << " workers" << std::endl;
+
+  const auto start_time = now();
+  std::vector<analysisthread*> pool;
+  for (auto i = 0; i < workers; ++i)
+    pool.push_back(new analysisthread(&batch, hash_mb));
+  for (auto* th : pool) th->wake(true);
+
+  auto last_info = start_time;
+  while (batch.lines_done < batch.lines.size()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    for (auto* th : pool) th->check_limits();
+
+    if (const auto time = now(); time - last_info >= 1000) {
+      last_info = time;
+      acout() << "info string analyze " << batch.lines_done << '/'
+        << batch.lines.size() << std::endl;
+    }
+  }
+
+  for (auto* th : pool) {
+    th->wait_for_search_to_end();
+    delete th;
+  }
+  batch.out.close();
+
+  const auto elapsed_time = static_cast<double>(now() + 1 - start_time) / 1000;
+  const auto nps = static_cast<double>(batch.nodes) / elapsed_time;
+
+  acout() << "positions " << batch.lines.size() << std::endl;
+  acout() << "nodes " << batch.nodes << std::endl;
+
+  std::ostringstream ss;
+
+  ss.precision(2);
+  ss << "time " << std::fixed << elapsed_time << " secs" << std::endl;
+  acout() << ss.str();
+  ss.str(std::string());
+
+  ss.precision(0);
+  ss << "nps " << std::fixed << nps << std::endl;
+  acout() << ss.str();
+  return fflush(stdout);
+}
@@ -0,0 +1,4 @@
+#pragma once
+#include <sstream>
+
+int analyze(std::istringstream& is);
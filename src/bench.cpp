@@ -1,73 +1,522 @@
 #include "bench.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
 #include <sstream>
+#include <vector>
+#include "evaluate.h"
+#include "hash.h"
+#include "hwcounters.h"
+#include "movegen.h"
+#include "nnue.h"
+#include "perft.h"
 #include "thread.h"
 #include "uci.h"
 #include "util.h"
 
-int bench(const int depth) {
-  int ret = 0;
-  uint64_t nodes = 0;
-  auto pos_num = 0;
-  position pos{};
+namespace {
+  constexpr int num_positions = std::size(bench_positions);
+
+  struct bench_sample {
+    uint64_t nodes;
+    int64_t micros;
+    hw_sample hw;
+  };
+
+  double nps_of(const bench_sample& s) {
+    return static_cast<double>(s.nodes) * 1000000 /
+      static_cast<double>(std::max(s.micros, static_cast<int64_t>(1)));
+  }
+
+  double per_node(const bench_sample& s, const hw_event e) {
+    return static_cast<double>(s.hw.value[e]) /
+      static_cast<double>(std::max(s.nodes, static_cast<uint64_t>(1)));
+  }
+
+  double ipc(const bench_sample& s) {
+    return static_cast<double>(s.hw.value[hw_instructions]) /
+      static_cast<double>(std::max(s.hw.value[hw_cycles],
+        static_cast<uint64_t>(1)));
+  }
+
+  // events the host does not count print as n/a (null in json)
+  void print_hw(std::ostringstream& ss, const bench_sample& s,
+    const hwcounters& hw, const bool json) {
+    const auto na = json ? "null" : "n/a";
+    const auto has_ipc =
+      hw.available(hw_cycles) && hw.available(hw_instructions);
+    ss.precision(2);
+    ss << (json ? "{\"ipc\":" : "ipc ") << std::fixed;
+    if (has_ipc)
+      ss << ipc(s);
+    else
+      ss << na;
+    for (auto e = 0; e < hw_event_count; ++e) {
+      ss << (json ? ",\"" : " ") << hw_event_name[e]
+        << (json ? "_per_node\":" : "/node ");
+      if (hw.available(static_cast<hw_event>(e)))
+        ss << per_node(s, static_cast<hw_event>(e));
+      else
+        ss << na;
+    }
+    if (json) ss << "}";
+  }
 
-  const auto start_time = now();
+  double median(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    const auto n = v.size();
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+  }
 
-  for (auto& bench_position : bench_positions) {
-    auto num_positions = 32;
-    const auto start_time_pos = now();
-    uint64_t nodes_pos = 0;
+  double stddev(const std::vector<double>& v) {
+    if (v.size() < 2) return 0;
+    double mean = 0, var = 0;
+    for (const auto x : v) mean += x;
+    mean /= static_cast<double>(v.size());
+    for (const auto x : v) var += (x - mean) * (x - mean);
+    return std::sqrt(var / static_cast<double>(v.size() - 1));
+  }
 
-    pos_num++;
+  bench_sample bench_position(position& pos, const int pos_num,
+    const std::string& limit, const bool print, const hwcounters* hw) {
     search::reset();
-    auto s_depth = "depth " + std::to_string(depth);
-    std::istringstream is(s_depth);
-    pos.set(bench_position, false, thread_pool.main());
-    acout() << "position " << pos_num << '/' << num_positions << " "
-      << bench_position << " ";
+    std::istringstream is(limit);
+    pos.set(bench_positions[pos_num], false, thread_pool.main());
+
+    const auto hw_start = hw ? hw->read() : hw_sample{};
+    const auto start_time_pos = now_micros();
     go(pos, is);
     thread_pool.main()->wait_for_search_to_end();
+    const bench_sample s{thread_pool.visited_nodes(),
+      now_micros() - start_time_pos, hw ? hw->read() - hw_start : hw_sample{}};
+
+    if (print) {
+      std::ostringstream ss;
+      ss << "position " << pos_num + 1 << '/' << num_positions << " "
+        << bench_positions[pos_num] << " ";
+      ss.precision(0);
+      ss << "[" << std::fixed << s.nodes << " nodes ";
+      ss.precision(2);
+      ss << std::fixed << static_cast<double>(s.micros) / 1000000 << " secs ";
+      ss.precision(0);
+      ss << std::fixed << nps_of(s) << " nps]";
+      if (hw) {
+        ss << " [";
+        print_hw(ss, s, *hw, false);
+        ss << "]";
+      }
+      ss << std::endl;
+      acout() << ss.str();
+    }
+    return s;
+  }
+
+  bench_sample search_positions(position& pos, const char* const* fens,
+    const int count, const std::string& limit) {
+    bench_sample total{0, 0, {}};
+    for (auto p = 0; p < count; ++p) {
+      search::reset();
+      std::istringstream is(limit);
+      pos.set(fens[p], false, thread_pool.main());
+      const auto start_time_pos = now_micros();
+      go(pos, is);
+      thread_pool.main()->wait_for_search_to_end();
+      total.nodes += thread_pool.visited_nodes();
+      total.micros += now_micros() - start_time_pos;
+    }
+    return total;
+  }
+}
+
+int bench(const bench_options& opt) {
+  const auto runs = std::max(opt.runs, 1);
+  const auto threads = std::clamp(opt.threads, 1, max_threads);
+
+  if (threads != uci_threads) thread_pool.change_thread_count(threads);
+  if (opt.hash != uci_hash) main_hash.init(opt.hash);
+
+  // counters are opened per thread, so after the thread count is final
+  hwcounters counters;
+  const auto* hw = opt.perf && counters.open() ? &counters : nullptr;
+  if (opt.perf && !hw)
+    acout() << "info string perf counters unavailable" << std::endl;
 
-    nodes_pos += thread_pool.visited_nodes();
-    nodes += thread_pool.visited_nodes();
-    const auto elapsed_time_pos =
-      static_cast<double>(now() + 1 - start_time_pos) / 1000;
-    const auto nps_pos = static_cast<double>(nodes_pos) / elapsed_time_pos;
+  const auto sort_work_start = thread_pool.sort_work();
+  search::reset_stats();
+  search::reset_profile();
 
-    std::ostringstream ss;
+  // samples[run][position]
+  std::vector<std::vector<bench_sample>> samples(runs);
+  std::vector<bench_sample> totals(runs, bench_sample{0, 0, {}});
+  position pos{};
+  const auto limit = "depth " + std::to_string(opt.depth);
+
+  for (auto r = 0; r < runs; ++r) {
+    if (runs > 1 && !opt.json)
+      acout() << "run " << r + 1 << '/' << runs << std::endl;
+    for (auto p = 0; p < num_positions; ++p) {
+      const auto s = bench_position(pos, p, limit, !opt.json, hw);
+      samples[r].push_back(s);
+      totals[r].nodes += s.nodes;
+      totals[r].micros += s.micros;
+      totals[r].hw += s.hw;
+    }
+  }
+
+  // the node count of the first run is the functional signature: zobrist
+  // keys come from a fixed seed, so single threaded it only changes when
+  // search or eval behaviour changes
+  const auto signature = totals[0].nodes;
+  std::vector<double> run_nps, run_secs;
+  for (const auto& t : totals) {
+    run_nps.push_back(nps_of(t));
+    run_secs.push_back(static_cast<double>(t.micros) / 1000000);
+  }
+
+  std::ostringstream ss;
+  if (opt.json) {
     ss.precision(0);
-    ss << "[" << std::fixed << nodes_pos << " nodes ";
-    acout() << ss.str();
+    ss << std::fixed << "{\"depth\":" << opt.depth << ",\"threads\":" << threads
+      << ",\"hash\":" << opt.hash << ",\"runs\":" << runs
+      << ",\"make_method\":\"" << make_method << "\",\"signature\":"
+      << signature << ",\"positions\":[";
+    for (auto p = 0; p < num_positions; ++p) {
+      std::vector<double> nps, micros;
+      for (auto r = 0; r < runs; ++r) {
+        nps.push_back(nps_of(samples[r][p]));
+        micros.push_back(static_cast<double>(samples[r][p].micros));
+      }
+      ss << (p ? "," : "") << "{\"fen\":\"" << bench_positions[p]
+        << "\",\"nodes\":" << samples[0][p].nodes
+        << ",\"time_us\":" << median(micros) << ",\"nps\":" << median(nps)
+        << ",\"nps_stddev\":" << stddev(nps);
+      if (hw) {
+        ss << ",\"perf\":";
+        print_hw(ss, samples[0][p], *hw, true);
+        ss.precision(0);
+      }
+      ss << "}";
+    }
+    ss << "],\"run_nps\":[";
+    for (auto r = 0; r < runs; ++r) ss << (r ? "," : "") << run_nps[r];
+    ss << "],\"nps_median\":" << median(run_nps)
+      << ",\"nps_stddev\":" << stddev(run_nps);
+    if (hw) {
+      ss << ",\"perf\":";
+      print_hw(ss, totals[0], *hw, true);
+    }
+    ss << "}" << std::endl;
+  }
+  else {
+    ss << "depth " << opt.depth << std::endl;
+    ss << "make method " << make_method << std::endl;
+    ss << "threads " << threads << std::endl;
+    ss << "hash " << opt.hash << std::endl;
+    ss << "nodes " << signature << std::endl;
+    ss << "sort work " << (thread_pool.sort_work() - sort_work_start) / runs
+      << std::endl;
+    if (hw) {
+      ss << "perf ";
+      print_hw(ss, totals[0], *hw, false);
+      ss << std::endl;
+    }
+    ss.precision(2);
+    ss << "time " << std::fixed << median(run_secs) << " secs" << std::endl;
+    ss.precision(0);
+    if (runs > 1)
+      ss << "nps stddev " << std::fixed << stddev(run_nps) << " over " << runs
+      << " runs" << std::endl;
+    ss << "nps " << std::fixed << median(run_nps) << std::endl;
+  }
+  acout() << ss.str();
+  if (!opt.json) search::print_profile();
+
+  if (threads != uci_threads) thread_pool.change_thread_count(uci_threads);
+  if (opt.hash != uci_hash) main_hash.init(uci_hash);
+  new_game();
+  return fflush(stdout);
+}
+
+// runs the bench positions at 1, 2, 4 .. n threads: once to a fixed depth
+// (nps and time-to-depth) and once at a fixed time per position (average
+// completed depth), speedups are relative to the single thread run
+int scalebench(const bench_options& opt) {
+  const auto max_thread_count = std::clamp(opt.threads, 1, max_threads);
+  std::vector<int> counts;
+  for (auto t = 1; t < max_thread_count; t *= 2) counts.push_back(t);
+  counts.push_back(max_thread_count);
+
+  if (opt.hash != uci_hash) main_hash.init(opt.hash);
+
+  const auto depth_limit = "depth " + std::to_string(opt.depth);
+  const auto time_limit = "movetime " + std::to_string(opt.move_time);
+  position pos{};
+  double base_nps = 0, base_secs = 0;
+
+  std::ostringstream ss;
+  ss << "scalebench depth " << opt.depth << " movetime " << opt.move_time
+    << " hash " << opt.hash << std::endl;
+  ss << "threads          nps  speedup   ttd secs  speedup  depth@time"
+    << std::endl;
+  acout() << ss.str();
+
+  for (const auto threads : counts) {
+    thread_pool.change_thread_count(threads);
+
+    bench_sample fixed_depth{0, 0, {}};
+    for (auto p = 0; p < num_positions; ++p) {
+      const auto s = bench_position(pos, p, depth_limit, false, nullptr);
+      fixed_depth.nodes += s.nodes;
+      fixed_depth.micros += s.micros;
+    }
+
+    int64_t depth_sum = 0;
+    for (auto p = 0; p < num_positions; ++p) {
+      bench_position(pos, p, time_limit, false, nullptr);
+      depth_sum += std::max(thread_pool.main()->completed_depth, 0);
+    }
+
+    const auto nps = nps_of(fixed_depth);
+    const auto secs = static_cast<double>(fixed_depth.micros) / 1000000;
+    if (threads == 1) {
+      base_nps = nps;
+      base_secs = secs;
+    }
 
     ss.str(std::string());
+    ss.precision(0);
+    ss << std::fixed << std::setw(7) << threads << std::setw(13) << nps;
     ss.precision(2);
-    ss << std::fixed << elapsed_time_pos << " secs ";
+    ss << std::setw(9) << nps / base_nps << std::setw(11) << secs
+      << std::setw(9) << base_secs / std::max(secs, 0.001) << std::setw(12)
+      << static_cast<double>(depth_sum) / (num_positions * plies)
+      << std::endl;
     acout() << ss.str();
-    ss.str(std::string());
+  }
+
+  thread_pool.change_thread_count(uci_threads);
+  if (opt.hash != uci_hash) main_hash.init(uci_hash);
+  new_game();
+  return fflush(stdout);
+}
 
+// the profile-build training run: bench positions single threaded, with
+// opt.threads threads and with MultiPV, then tactical and endgame positions
+// and perft, so the profile covers smp, multipv, qsearch and endgame code
+// rather than single threaded middlegame search only
+int pgobench(const bench_options& opt) {
+  struct perft_position {
+    const char* fen;
+    int depth;
+  };
+  static constexpr perft_position perft_positions[] = {
+    {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -", 6},
+    {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -", 5},
+    {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -", 6},
+  };
+  constexpr int multi_pv = 4;
+
+  const auto threads = std::clamp(opt.threads, 1, max_threads);
+  const auto depth = "depth " + std::to_string(opt.depth);
+  const auto short_depth =
+    "depth " + std::to_string(std::max(opt.depth - 2, 1));
+  if (opt.hash != uci_hash) main_hash.init(opt.hash);
+  position pos{};
+
+  std::ostringstream ss;
+  ss << "pgobench depth " << opt.depth << " threads " << threads << " hash "
+    << opt.hash << std::endl;
+  ss << "phase       positions         nodes      secs          nps"
+    << std::endl;
+  acout() << ss.str();
+
+  bench_sample total{0, 0, {}};
+  auto total_positions = 0;
+  const auto print_row = [&](const char* phase, const int count,
+    const bench_sample& s) {
+    ss.str(std::string());
+    ss << std::left << std::setw(10) << phase << std::right << std::setw(11)
+      << count << std::setw(14) << s.nodes;
+    ss.precision(2);
+    ss << std::fixed << std::setw(10)
+      << static_cast<double>(s.micros) / 1000000;
     ss.precision(0);
-    ss << std::fixed << nps_pos << " nps]" << std::endl;
+    ss << std::setw(13) << nps_of(s) << std::endl;
     acout() << ss.str();
-    ss.str(std::string());
-    ret = fflush(stdout);
+  };
+  const auto report = [&](const char* phase, const int count,
+    const bench_sample& s) {
+    total.nodes += s.nodes;
+    total.micros += s.micros;
+    total_positions += count;
+    print_row(phase, count, s);
+  };
+
+  thread_pool.change_thread_count(1);
+  report("bench", num_positions,
+    search_positions(pos, bench_positions, num_positions, depth));
+
+  thread_pool.change_thread_count(threads);
+  report("smp", num_positions,
+    search_positions(pos, bench_positions, num_positions, depth));
+  thread_pool.change_thread_count(1);
+
+  const auto saved_multi_pv = uci_multipv;
+  uci_multipv = multi_pv;
+  report("multipv", num_positions,
+    search_positions(pos, bench_positions, num_positions, short_depth));
+  uci_multipv = saved_multi_pv;
+
+  report("tactical", static_cast<int>(std::size(tactical_positions)),
+    search_positions(pos, tactical_positions,
+      static_cast<int>(std::size(tactical_positions)), depth));
+  report("endgame", static_cast<int>(std::size(endgame_positions)),
+    search_positions(pos, endgame_positions,
+      static_cast<int>(std::size(endgame_positions)), depth));
+
+  bench_sample perft_total{0, 0, {}};
+  for (const auto& p : perft_positions) {
+    search::reset();
+    pos.set(p.fen, false, thread_pool.main());
+    const auto start_time = now_micros();
+    perft_total.nodes += start_perft(pos, p.depth);
+    perft_total.micros += now_micros() - start_time;
   }
-  const auto elapsed_time = static_cast<double>(now() + 1 - start_time) / 1000;
-  const auto nps = static_cast<double>(nodes) / elapsed_time;
+  print_row("search", total_positions, total);
+  print_row("perft", static_cast<int>(std::size(perft_positions)),
+    perft_total);
 
-  acout() << "depth " << depth << std::endl;
-  acout() << "nodes " << nodes << std::endl;
+  thread_pool.change_thread_count(uci_threads);
+  if (opt.hash != uci_hash) main_hash.init(uci_hash);
+  new_game();
+  return fflush(stdout);
+}
 
-  std::ostringstream ss;
+// first hidden layer cost over the bench positions and all their children,
+// bucketed by the share of non-zero 4-byte input chunks: dense walks every
+// weight column, sparse only the columns of non-zero chunks. then the
+// accumulator cost of each bench position to child move, incrementally and
+// by full refresh
+int nnuebench(const int reps) {
+  constexpr int buckets = 10;
+  struct density_bucket {
+    int positions;
+    double density, dense_ns, sparse_ns;
+  } table[buckets]{};
 
+  search::reset();
+  position pos{};
+  std::vector<nnue_position> parents, children;
+  const auto sample = [&](const position& p, nnue_position* np) {
+    *np = nnue_position{};
+    np->player = p.on_move();
+    evaluate::nnue_input(p, np->pieces, np->squares);
+    nnue_l1_sample s{};
+    if (!nnue_bench_l1(np->player, np->pieces, np->squares, reps, &s))
+      return false;
+    auto& b = table[std::min(static_cast<int>(s.density * buckets),
+      buckets - 1)];
+    b.positions++;
+    b.density += s.density;
+    b.dense_ns += s.dense_ns;
+    b.sparse_ns += s.sparse_ns;
+    return true;
+  };
+  for (auto p = 0; p < num_positions; ++p) {
+    pos.set(bench_positions[p], false, thread_pool.main());
+    nnue_position parent;
+    if (!sample(pos, &parent)) {
+      acout() << "info string no network loaded" << std::endl;
+      return 1;
+    }
+    for (const auto& m : legal_move_list(pos)) {
+      pos.play_move(m, pos.give_check(m));
+      parents.push_back(parent);
+      sample(pos, &children.emplace_back());
+      pos.take_move_back(m);
+    }
+  }
+  nnue_update_sample acc{};
+  nnue_bench_accumulator(parents.data(), children.data(),
+    static_cast<int>(children.size()), reps, &acc);
+
+  std::ostringstream ss;
+  ss << "nnuebench reps " << reps << std::endl;
+  ss << "density  positions   dense ns  sparse ns  speedup" << std::endl;
+  density_bucket total{};
+  for (const auto& b : table) {
+    total.positions += b.positions;
+    total.density += b.density;
+    total.dense_ns += b.dense_ns;
+    total.sparse_ns += b.sparse_ns;
+  }
   ss.precision(2);
-  ss << "time " << std::fixed << elapsed_time << " secs" << std::endl;
+  for (const auto& b : table) {
+    if (!b.positions) continue;
+    ss << std::fixed << std::setw(7) << b.density / b.positions
+      << std::setw(11) << b.positions << std::setw(11)
+      << b.dense_ns / b.positions << std::setw(11)
+      << b.sparse_ns / b.positions << std::setw(9)
+      << b.dense_ns / std::max(b.sparse_ns, 0.001) << std::endl;
+  }
+  ss << "average" << std::setw(11) << total.positions << std::setw(11)
+    << total.dense_ns / total.positions << std::setw(11)
+    << total.sparse_ns / total.positions << std::setw(9)
+    << total.dense_ns / std::max(total.sparse_ns, 0.001) << std::endl;
+  ss << "mean density " << total.density / total.positions << std::endl;
+  ss << "accumulator update ns " << acc.update_ns << " refresh ns "
+    << acc.refresh_ns << " over " << children.size() << " moves";
+  if (acc.mismatches) ss << ", " << acc.mismatches << " updates differ";
+  ss << std::endl;
   acout() << ss.str();
-  ss.str(std::string());
+  return fflush(stdout);
+}
+
+// evaluation differences between the active net and eval_file over the
+// positions of an epd file, or the bench positions and their children
+int nnuecheck(const std::string& eval_file, const std::string& epd_file) {
+  search::reset();
+  position pos{};
+  std::vector<nnue_position> positions;
+  const auto add = [&] {
+    auto& np = positions.emplace_back();
+    np.player = pos.on_move();
+    evaluate::nnue_input(pos, np.pieces, np.squares);
+  };
+  if (!epd_file.empty()) {
+    std::ifstream in(epd_file);
+    for (std::string line; std::getline(in, line);) {
+      std::istringstream is(line);
+      std::string fen, token;
+      for (auto i = 0; i < 4 && is >> token; ++i) fen += token + " ";
+      if (fen.empty()) continue;
+      pos.set(fen, false, thread_pool.main());
+      add();
+    }
+  }
+  else
+    for (auto p = 0; p < num_positions; ++p) {
+      pos.set(bench_positions[p], false, thread_pool.main());
+      add();
+      for (const auto& m : legal_move_list(pos)) {
+        pos.play_move(m, pos.give_check(m));
+        add();
+        pos.take_move_back(m);
+      }
+    }
 
-  ss.precision(0);
-  ss << "nps " << std::fixed << nps << std::endl;
+  nnue_compare_sample s{};
+  if (!nnue_compare(eval_file.c_str(), positions.data(),
+    static_cast<int>(positions.size()), &s)) {
+    acout() << "info string cannot compare with " << eval_file << std::endl;
+    return 1;
+  }
+  std::ostringstream ss;
+  ss.precision(2);
+  ss << "nnuecheck " << eval_file << " positions " << positions.size()
+    << " mean |diff| " << std::fixed << s.mean_abs << " max |diff| "
+    << s.max_abs << " over 10 " << s.over_10 << std::endl;
   acout() << ss.str();
-  ss.str(std::string());
-  new_game();
-  ret = fflush(stdout);
-  return ret;
+  return fflush(stdout);
 }
@@ -1,4 +1,5 @@
 #pragma once
+#include <string>
 static const char* bench_positions[] = {
   "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -",
   "r1bn1rk1/ppp1qppp/3pp3/3P4/2P1n3/2B2NP1/PP2PPBP/2RQK2R w K -",
@@ -33,4 +34,43 @@ static const char* bench_positions[] = {
   "r1b3k1/2p4p/3p1p2/1p1P4/1P3P2/P5P1/5KNP/R7 b - -",
   "1k2b3/1pp5/4r3/R3N1pp/1P3P2/p5P1/2P4P/1K6 w - -",
 };
-int bench(int depth);
\ No newline at end of file
+
+// profile training positions for pgobench: tactical ones that keep
+// qsearch and check evasions busy, and endgames
+static const char* tactical_positions[] = {
+  "2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - -",
+  "5rk1/1ppb3p/p1pb4/6q1/3P1p1r/2P1R2P/PP1BQ1P1/5RKN w - -",
+  "r1bq2rk/pp3pbp/2p1p1pQ/7P/3P4/2PB1N2/PP3PPR/2KR4 w - -",
+  "r4q1k/p2bR1rp/2p2Q1N/5p2/5p2/2P5/PP3PPP/R5K1 w - -",
+  "3q1rk1/p4pp1/2pb3p/3p4/6Pr/1PNQ4/P1PB1PP1/4RRK1 b - -",
+  "r1b1kb1r/3q1ppp/pBp1pn2/8/Np3P2/5B2/PPP3PP/R2Q1RK1 w kq -",
+  "r2qkb1r/pp2nppp/3p4/2pNN1B1/2BnP3/3P4/PPP2PPP/R2bK2R w KQkq -",
+  "1k1r4/pp1b1R2/3q2pp/4p3/2B5/4Q3/PPP2B2/2K5 b - -",
+};
+
+static const char* endgame_positions[] = {
+  "8/k7/3p4/p2P1p2/P2P1P2/8/8/K7 w - -",
+  "8/8/8/8/5kp1/P7/8/1K1N4 w - -",
+  "1K1k4/1P6/8/8/8/8/r7/2R5 w - -",
+  "4k3/8/8/4PK2/8/8/r7/1R6 b - -",
+  "8/8/8/4k3/8/8/8/4KBN1 w - -",
+  "8/8/8/2k5/8/8/2r5/3QK3 w - -",
+  "8/5pk1/6p1/7p/7P/6P1/5PK1/8 w - -",
+  "6k1/5p2/6p1/8/7p/8/6PP/6K1 b - -",
+};
+
+struct bench_options {
+  int depth = 14;
+  int threads = 1;
+  int hash = 64;
+  int runs = 1;
+  bool json = false;
+  bool perf = false;
+  int move_time = 500;
+};
+
+int bench(const bench_options& opt);
+int scalebench(const bench_options& opt);
+int pgobench(const bench_options& opt);
+int nnuebench(int reps);
+int nnuecheck(const std::string& eval_file, const std::string& epd_file);
\ No newline at end of file
@@ -30,7 +30,7 @@ void timecontrol::init(const search_param& limit, const side me,
     int64_t t2 =
       std::llround(static_cast<double>(available) * std::min(ratio2, ratio3));
 
-    optimal_time_ = std::min(t1, optimal_time_);
+    optimal_time_ = std::min(t1, optimal_time_.load());
     maximum_time_ = std::min(t2, maximum_time_);
 
     other_moves_importance += calc_move_importance(ply + 2 * n);
@@ -38,12 +38,12 @@ void timecontrol::init(const search_param& limit, const side me,
       static_cast<int64_t>(move_overhead);
   }
 
-  optimal_time_ = std::max(optimal_time_, minimum_time);
+  optimal_time_ = std::max(optimal_time_.load(), minimum_time);
   maximum_time_ = std::max(maximum_time_, minimum_time);
 
   if (uci_ponder) {
     optimal_time_ += optimal_time_ * 3 / 10;
-    optimal_time_ = std::min(optimal_time_, maximum_time_);
+    optimal_time_ = std::min(optimal_time_.load(), maximum_time_);
   }
 }
 
@@ -1,4 +1,5 @@
 ﻿#pragma once
+#include <atomic>
 #include "main.h"
 
 using time_point = std::chrono::milliseconds::rep;
@@ -10,6 +11,12 @@ inline time_point now() {
     .count();
 }
 
+inline int64_t now_micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
 struct search_param {
   search_param()
     : moves_to_go(0),
@@ -22,12 +29,33 @@ struct search_param {
     moves_to_go = depth = move_time = mate = infinite = ponder =
     0) {}
 
+  search_param(const search_param& other) {
+    *this = other;
+  }
+
+  search_param& operator=(const search_param& other) {
+    std::copy_n(other.time, num_sides, time);
+    std::copy_n(other.inc, num_sides, inc);
+    moves_to_go = other.moves_to_go;
+    depth = other.depth;
+    move_time = other.move_time;
+    mate = other.mate;
+    infinite = other.infinite;
+    ponder = other.ponder.load();
+    nodes = other.nodes;
+    search_moves = other.search_moves;
+    start_time = other.start_time;
+    return *this;
+  }
+
   [[nodiscard]] bool use_time_calculating() const {
     return !(mate | move_time | depth | nodes | infinite);
   }
 
   int time[num_sides]{}, inc[num_sides]{}, moves_to_go, depth, move_time, mate,
-    infinite, ponder;
+    infinite;
+  // cleared by the timer thread on ponderhit while search threads read it
+  std::atomic<int> ponder;
   uint64_t nodes;
   max_moves_list search_moves;
   time_point start_time = 0;
@@ -51,7 +79,8 @@ public:
   int move_overhead = 50;
 private:
   time_point start_time_ = 0;
-  int64_t optimal_time_ = 0;
+  // a ponderhit rescales it on the timer thread while search reads it
+  std::atomic<int64_t> optimal_time_ = 0;
   int64_t maximum_time_ = 0;
 
   double x_scale_ = 7.64;
@@ -1,11 +1,12 @@
 #include "main.h"
 #include "nnue.h"
 #include "position.h"
+#include "profile.h"
 
 namespace evaluate {
-  static int eval_nnue(const position& pos) {
-    int pieces[33]{};
-    int squares[33]{};
+  // piece and square lists in the nnue layout: both kings first, then the
+  // rest, zero terminated
+  void nnue_input(const position& pos, int* pieces, int* squares) {
     int index = 2;
     for (uint8_t i = 0; i < 64; i++) {
       if (pos.piece_on_square(static_cast<square>(i)) == 1) {
@@ -67,11 +68,18 @@ namespace evaluate {
         index++;
       }
     }
+  }
+
+  static int eval_nnue(const position& pos) {
+    int pieces[33]{};
+    int squares[33]{};
+    nnue_input(pos, pieces, squares);
     const int nnue_score = nnue_evaluate(pos.on_move(), pieces, squares);
     return nnue_score;
   }
 
   int eval(const position& pos) {
+    HOT_SCOPE(hot_eval);
     const int nnue_score = eval_nnue(pos);
     return nnue_score;
   }
@@ -5,4 +5,5 @@ class position;
 namespace evaluate {
   int eval(const position& pos);
   int eval_after_null_move(int eval);
+  void nnue_input(const position& pos, int* pieces, int* squares);
 }   
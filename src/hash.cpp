@@ -2,6 +2,7 @@
 #include <cstring>
 #include <iostream>
 #include "main.h"
+#include "profile.h"
 
 hash main_hash;
 
@@ -29,6 +30,7 @@ void hash::clear() const {
 }
 
 main_hash_entry* hash::probe(const uint64_t key) const {
+  HOT_SCOPE(hot_hash_probe);
   auto* const hash_entry = entry(key);
   const uint16_t key16 = key >> 48;
 
@@ -45,6 +47,7 @@ main_hash_entry* hash::probe(const uint64_t key) const {
 }
 
 main_hash_entry* hash::replace(const uint64_t key) const {
+  HOT_SCOPE(hot_hash_replace);
   auto* const hash_entry = entry(key);
   const uint16_t key16 = key >> 48;
 
@@ -0,0 +1,112 @@
+#include "hwcounters.h"
+#ifdef __linux__
+#include <algorithm>
+#include <cerrno>
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstdlib>
+#endif
+
+#ifdef __linux__
+namespace {
+  struct event_config {
+    uint32_t type;
+    uint64_t config;
+  };
+
+  constexpr event_config event_configs[hw_event_count] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {
+      PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+      PERF_COUNT_HW_CACHE_RESULT_MISS << 16
+    },
+    {
+      PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_LL | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+      PERF_COUNT_HW_CACHE_RESULT_MISS << 16
+    },
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+  };
+
+  int open_event(const event_config& ec, const pid_t tid) {
+    perf_event_attr attr{};
+    attr.size = sizeof attr;
+    attr.type = ec.type;
+    attr.config = ec.config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0));
+  }
+}
+
+// counters are per thread: open one set for each task of the process, the
+// search threads must therefore exist before open() is called. an event the
+// host does not support (the generic llc events on many amd hosts and vms)
+// is left out on every thread, any other error closes all counters
+bool hwcounters::open() {
+  close();
+  auto* dir = opendir("/proc/self/task");
+  if (!dir) return false;
+
+  bool unsupported[hw_event_count]{};
+  while (const auto* entry = readdir(dir)) {
+    if (entry->d_name[0] == '.') continue;
+    const auto tid = static_cast<pid_t>(atoi(entry->d_name));
+    for (auto e = 0; e < hw_event_count; ++e) {
+      if (unsupported[e]) continue;
+      const auto fd = open_event(event_configs[e], tid);
+      if (fd >= 0)
+        counters_.push_back({fd, static_cast<hw_event>(e)});
+      else if (errno == ENOENT || errno == EOPNOTSUPP)
+        unsupported[e] = true;
+      else {
+        closedir(dir);
+        close();
+        return false;
+      }
+    }
+  }
+  closedir(dir);
+
+  // an event missing on one thread would undercount, drop it everywhere
+  std::erase_if(counters_, [&](const counter& c) {
+    if (!unsupported[c.event]) return false;
+    ::close(c.fd);
+    return true;
+    });
+  for (const auto& c : counters_) available_[c.event] = true;
+  return !counters_.empty();
+}
+
+void hwcounters::close() {
+  for (const auto& c : counters_) ::close(c.fd);
+  counters_.clear();
+  std::fill_n(available_, hw_event_count, false);
+}
+
+hw_sample hwcounters::read() const {
+  hw_sample s;
+  for (const auto& c : counters_) {
+    // value, time enabled, time running: scale when the pmu multiplexed
+    uint64_t data[3]{};
+    if (::read(c.fd, data, sizeof data) != sizeof data || !data[2])
+      continue;
+    const auto value = data[2] < data[1]
+      ? static_cast<uint64_t>(static_cast<double>(data[0]) *
+        static_cast<double>(data[1]) / static_cast<double>(data[2]))
+      : data[0];
+    s.value[c.event] += value;
+  }
+  return s;
+}
+#else
+bool hwcounters::open() { return false; }
+void hwcounters::close() {}
+hw_sample hwcounters::read() const { return {}; }
+#endif
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// hardware performance counters (linux perf_event_open), user space only,
+// summed over every thread of the engine process
+enum hw_event : uint8_t {
+  hw_cycles,
+  hw_instructions,
+  hw_l1d_misses,
+  hw_llc_misses,
+  hw_branch_misses,
+  hw_event_count
+};
+
+struct hw_sample {
+  uint64_t value[hw_event_count]{};
+
+  hw_sample operator-(const hw_sample& s) const {
+    hw_sample r;
+    for (auto i = 0; i < hw_event_count; ++i) r.value[i] = value[i] - s.value[i];
+    return r;
+  }
+
+  hw_sample& operator+=(const hw_sample& s) {
+    for (auto i = 0; i < hw_event_count; ++i) value[i] += s.value[i];
+    return *this;
+  }
+};
+
+inline const char* hw_event_name[hw_event_count] = {
+  "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+};
+
+class hwcounters {
+  struct counter {
+    int fd;
+    hw_event event;
+  };
+  std::vector<counter> counters_;
+  bool available_[hw_event_count]{};
+public:
+  hwcounters() = default;
+  hwcounters(const hwcounters&) = delete;
+  hwcounters& operator=(const hwcounters&) = delete;
+  ~hwcounters() { close(); }
+  bool open();
+  void close();
+  [[nodiscard]] hw_sample read() const;
+  // false for events the pmu or hypervisor does not provide
+  [[nodiscard]] bool available(const hw_event e) const {
+    return available_[e];
+  }
+};
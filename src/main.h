@@ -27,6 +27,16 @@
 #define CACHE_ALIGN __attribute__((aligned(64)))
 #endif
 
+// ARCH=x86-64-fat builds everything for x86-64-v3, the level the nnue
+// kernels need, and gives the hot entry points an x86-64-v4 clone as well.
+// the dynamic loader resolves each one through ifunc, see isa_level()
+#if defined(FAT_BINARY)
+#define ISA_CLONES \
+  __attribute__((target_clones("arch=x86-64-v4", "default"), flatten))
+#else
+#define ISA_CLONES
+#endif
+
 enum square : int8_t;
 
 #if defined(_MSC_VER)
@@ -64,11 +74,18 @@ constexpr auto bmis = "avx2";
 constexpr auto author = "Norman Schmidt";
 constexpr auto platform = "x64";
 
+#ifdef COPY_MAKE
+constexpr auto make_method = "copy-make";
+#else
+constexpr auto make_method = "make/unmake";
+#endif
+
 constexpr int default_hash = 64;
 constexpr int max_hash = 1048576;
 constexpr int max_threads = 256;
 constexpr int max_moves = 256;
 constexpr int max_ply = 128;
+constexpr int max_game_history = 128;
 constexpr int max_pv = 63;
 
 constexpr int value_pawn = 200;
@@ -145,6 +162,8 @@ constexpr int promotion_b = 12 << 12;
 constexpr int promotion_r = 13 << 12;
 constexpr int promotion_q = 14 << 12;
 
+constexpr uint32_t see_failed = 1 << 16;
+
 constexpr int plies = 8;
 constexpr int main_thread_inc = 9;
 constexpr int other_thread_inc = 9;
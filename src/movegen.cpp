@@ -3,6 +3,7 @@
 #include "macro.h"
 #include "main.h"
 #include "position.h"
+#include "profile.h"
 
 namespace movegen {
   template <side me, move_gen type>
@@ -74,7 +75,7 @@ namespace movegen {
 
     if (const auto direction = to_k > from_k ? west : east; chess960) {
       for (auto sq = to_k; sq != from_k; sq += direction)
-        if (pos.attack_to(sq) & pos.pieces(you)) return moves;
+        if (pos.king_danger() & sq) return moves;
 
       if (const auto from_r = pos.castle_rook_square(to_k);
         attack_rook_bb(to_k, pos.pieces() ^ from_r) &
@@ -82,8 +83,7 @@ namespace movegen {
         return moves;
     }
     else {
-      if (pos.attack_to(to_k) & pos.pieces(you)) return moves;
-      if (pos.attack_to(to_k + direction) & pos.pieces(you)) return moves;
+      if (pos.king_danger() & bb2(to_k, to_k + direction)) return moves;
     }
 
     const auto move = make_move(castle_move, from_k, to_k);
@@ -151,7 +151,7 @@ namespace movegen {
         multi_move_bb &= pos.attack_from<pt_pawn>(pos.king(you), you);
         double_move_bb &= pos.attack_from<pt_pawn>(pos.king(you), you);
 
-        if (const auto discovered_check = pos.info()->x_ray[~pos.on_move()];
+        if (const auto discovered_check = pos.pins()->x_ray[~pos.on_move()];
           pawns_not_7th_rank & discovered_check) {
           const uint64_t deduction_forward =
             shift_up<me>(pawns_not_7th_rank & discovered_check) &
@@ -249,7 +249,7 @@ namespace movegen {
           pos.info()->check_squares[piece]))
           continue;
 
-        if (pos.info()->x_ray[~pos.on_move()] & from) continue;
+        if (pos.pins()->x_ray[~pos.on_move()] & from) continue;
       }
 
       auto squares = pos.attack_from<piece>(from) & target;
@@ -264,7 +264,9 @@ namespace movegen {
 }
 
 template <move_gen mg>
+ISA_CLONES
 s_move* generate_moves(const position& pos, s_move* moves) {
+  HOT_SCOPE(hot_generate_moves);
   assert(mg == captures_promotions || mg == quiet_moves || mg == all_moves ||
     mg == castle_moves);
 
@@ -299,7 +301,9 @@ s_move* generate_captures_on_square(const position& pos, s_move* moves,
 }
 
 template <>
+ISA_CLONES
 s_move* generate_moves<evade_check>(const position& pos, s_move* moves) {
+  HOT_SCOPE(hot_generate_moves);
   const auto me = pos.on_move();
   const auto square_k = pos.king(me);
   uint64_t attacked_squares = 0;
@@ -326,6 +330,7 @@ s_move* generate_moves<evade_check>(const position& pos, s_move* moves) {
 
 template <>
 s_move* generate_moves<pawn_advances>(const position& pos, s_move* moves) {
+  HOT_SCOPE(hot_generate_moves);
   const auto me = pos.on_move();
   return me == white
     ? movegen::generate_pawn_advance<white>(pos, moves)
@@ -334,6 +339,7 @@ s_move* generate_moves<pawn_advances>(const position& pos, s_move* moves) {
 
 template <>
 s_move* generate_moves<queen_checks>(const position& pos, s_move* moves) {
+  HOT_SCOPE(hot_generate_moves);
   return pos.on_move() == white
     ? movegen::moves_for_piece<white, pt_queen, true>(pos, moves,
     ~pos.pieces())
@@ -343,6 +349,7 @@ s_move* generate_moves<queen_checks>(const position& pos, s_move* moves) {
 
 template <>
 s_move* generate_moves<quiet_checks>(const position& pos, s_move* moves) {
+  HOT_SCOPE(hot_generate_moves);
   const auto me = pos.on_move();
   auto deduction_check = pos.discovered_check_possible();
 
@@ -366,6 +373,7 @@ s_move* generate_moves<quiet_checks>(const position& pos, s_move* moves) {
     pos, moves, ~pos.pieces());
 }
 
+ISA_CLONES
 s_move* generate_legal_moves(const position& pos, s_move* moves) {
   const auto pinned = pos.pinned_pieces();
   const auto square_k = pos.king(pos.on_move());
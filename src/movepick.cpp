@@ -1,90 +1,110 @@
 #include "movepick.h"
 #include "main.h"
+#include "profile.h"
 #include "thread.h"
 
+#if defined(USE_AVX2)
+#include <climits>
+#include <immintrin.h>
+#endif
+
 namespace movepick {
   void init_search(const position& pos, const uint32_t hash_move, const int depth,
     const bool only_quiet_check_moves) {
     assert(depth >= plies);
-    auto* pi = pos.info();
-    pi->mp_depth = depth;
-    pi->mp_only_quiet_check_moves = only_quiet_check_moves;
-    pi->mp_hash_move =
+    const auto* pi = pos.info();
+    auto* mp = pos.mp_info();
+    mp->mp_depth = depth;
+    mp->mp_only_quiet_check_moves = only_quiet_check_moves;
+    mp->mp_hash_move =
       hash_move && pos.valid_move(hash_move) ? hash_move : no_move;
 
     if (pos.is_in_check())
-      pi->mp_stage = pi->mp_hash_move ? check_evasions : gen_check_evasions;
+      mp->mp_stage = mp->mp_hash_move ? check_evasions : gen_check_evasions;
     else {
-      pi->mp_stage = pi->mp_hash_move ? normal_search : gen_good_captures;
+      mp->mp_stage = mp->mp_hash_move ? normal_search : gen_good_captures;
       if (pi->move_counter_values) {
-        pi->mp_counter_move =
+        mp->mp_counter_move =
           static_cast<uint32_t>(pos.thread_info()->counter_moves.get(
           pi->moved_piece, to_square(pi->previous_move)));
-        if (!pi->mp_hash_move && (pi - 1)->move_counter_values &&
-          (!pi->mp_counter_move || !pos.valid_move(pi->mp_counter_move) ||
-          pos.capture_or_promotion(pi->mp_counter_move))) {
-          pi->mp_counter_move = pos.thread_info()->counter_followup_moves.get(
+        if (!mp->mp_hash_move && (pi - 1)->move_counter_values &&
+          (!mp->mp_counter_move || !pos.valid_move(mp->mp_counter_move) ||
+          pos.capture_or_promotion(mp->mp_counter_move))) {
+          mp->mp_counter_move = pos.thread_info()->counter_followup_moves.get(
             (pi - 1)->moved_piece, to_square((pi - 1)->previous_move),
             pi->moved_piece, to_square(pi->previous_move));
         }
       }
       else
-        pi->mp_counter_move = no_move;
+        mp->mp_counter_move = no_move;
     }
   }
 
   void init_q_search(const position& pos, const uint32_t hash_move,
     const int depth, const square sq) {
     assert(depth <= depth_0);
-    auto* pi = pos.info();
+    auto* mp = pos.mp_info();
 
     if (pos.is_in_check())
-      pi->mp_stage = check_evasions;
+      mp->mp_stage = check_evasions;
 
     else if (depth == depth_0)
-      pi->mp_stage = q_search_with_checks;
+      mp->mp_stage = q_search_with_checks;
 
     else if (depth >= -4 * plies)
-      pi->mp_stage = q_search_no_checks;
+      mp->mp_stage = q_search_no_checks;
 
     else {
-      pi->mp_stage = gen_recaptures;
-      pi->mp_capture_square = sq;
+      mp->mp_stage = gen_recaptures;
+      mp->mp_capture_square = sq;
       return;
     }
 
-    pi->mp_hash_move =
+    mp->mp_hash_move =
       hash_move && pos.valid_move(hash_move) ? hash_move : no_move;
-    if (!pi->mp_hash_move) ++pi->mp_stage;
+    if (!mp->mp_hash_move) ++mp->mp_stage;
   }
 
   void init_prob_cut(const position& pos, const uint32_t hash_move,
     const int limit) {
-    auto* pi = pos.info();
-    pi->mp_threshold = limit + 1;
+    auto* mp = pos.mp_info();
+    mp->mp_threshold = limit + 1;
 
-    pi->mp_hash_move = hash_move && pos.valid_move(hash_move) &&
+    mp->mp_hash_move = hash_move && pos.valid_move(hash_move) &&
       pos.capture_or_promotion(hash_move) &&
-      pos.see_test(hash_move, pi->mp_threshold)
+      pos.see_test(hash_move, mp->mp_threshold)
       ? hash_move
       : no_move;
 
-    pi->mp_stage = pi->mp_hash_move ? probcut : gen_probcut;
+    mp->mp_stage = mp->mp_hash_move ? probcut : gen_probcut;
   }
 
   template <>
   void score<captures_promotions>(const position& pos) {
-    const auto* const pi = pos.info();
-    for (auto* z = pi->mp_current_move; z < pi->mp_end_list; z++)
+    const auto* const mp = pos.mp_info();
+    for (auto* z = mp->mp_current_move; z < mp->mp_end_list; z++)
       z->value = capture_sort_values[pos.piece_on_square(to_square(z->move))] -
       200 * relative_rank(pos.on_move(), to_square(z->move));
   }
 
+#if defined(USE_AVX2)
+  // counter_move_history and max_gain_stats end in a spare int16_t and
+  // history is followed by evasion_history in threadinfo, so the 32-bit
+  // load of the last entry stays inside the object
+  static __m256i gather_int16(const int16_t* table, const __m256i offsets) {
+    const auto v = _mm256_i32gather_epi32(
+      reinterpret_cast<const int*>(table), offsets, 2);
+    return _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16);
+  }
+#endif
+
   template <>
   void score<quiet_moves>(const position& pos) {
     const auto& history = pos.thread_info()->history;
+    const auto& max_gain = pos.thread_info()->max_gain_table;
 
     const auto* pi = pos.info();
+    const auto* mp = pos.mp_info();
     const counter_move_values* cm =
       pi->move_counter_values
       ? pi->move_counter_values
@@ -99,29 +119,56 @@ namespace movepick {
       : &pos.cmh_info()->counter_move_stats[no_piece][a1];
 
     const auto threat =
-      pi->mp_depth < 6 * plies ? pos.calculate_threat() : no_square;
+      mp->mp_depth < 6 * plies ? pos.calculate_threat() : no_square;
+    const auto threat_bonus = 9000 - 1000 * (mp->mp_depth / plies);
+
+    auto* z = mp->mp_current_move;
+#if defined(USE_AVX2)
+    for (; z + 8 <= mp->mp_end_list; z += 8) {
+      alignas(32) int offsets[8], gain_offsets[8], values[8];
+      for (auto i = 0; i < 8; ++i) {
+        const auto piece = pos.moved_piece(z[i].move);
+        offsets[i] =
+          move_value_stats::calculate_offset(piece, to_square(z[i].move));
+        gain_offsets[i] = max_gain_stats::calculate_offset(piece, z[i].move);
+      }
 
-    for (auto* z = pi->mp_current_move; z < pi->mp_end_list; z++) {
+      const auto idx = _mm256_load_si256(reinterpret_cast<const __m256i*>(offsets));
+      auto sum = _mm256_add_epi32(
+        _mm256_add_epi32(gather_int16(history.values(), idx),
+        gather_int16(cm->values(), idx)),
+        _mm256_add_epi32(gather_int16(fm->values(), idx),
+        gather_int16(f2->values(), idx)));
+      const auto gains = gather_int16(max_gain.values(),
+        _mm256_load_si256(reinterpret_cast<const __m256i*>(gain_offsets)));
+      sum = _mm256_add_epi32(sum, _mm256_slli_epi32(gains, 3));
+      _mm256_store_si256(reinterpret_cast<__m256i*>(values), sum);
+
+      for (auto i = 0; i < 8; ++i)
+        z[i].value = values[i] +
+        (from_square(z[i].move) == threat ? threat_bonus : 0);
+    }
+#endif
+    for (; z < mp->mp_end_list; z++) {
       const auto offset = move_value_stats::calculate_offset(
         pos.moved_piece(z->move), to_square(z->move));
       z->value = static_cast<int>(history.value_at_offset(offset)) +
         static_cast<int>(cm->value_at_offset(offset)) +
         static_cast<int>(fm->value_at_offset(offset)) +
         static_cast<int>(f2->value_at_offset(offset));
-      z->value += 8 * pos.thread_info()->max_gain_table.get(
-        pos.moved_piece(z->move), z->move);
+      z->value += 8 * max_gain.get(pos.moved_piece(z->move), z->move);
 
       if (from_square(z->move) == threat)
-        z->value += 9000 - 1000 * (pi->mp_depth / plies);
+        z->value += threat_bonus;
     }
   }
 
   template <>
   void score<evade_check>(const position& pos) {
-    const auto* const pi = pos.info();
+    const auto* const mp = pos.mp_info();
     const auto& history = pos.thread_info()->evasion_history;
 
-    for (auto* z = pi->mp_current_move; z < pi->mp_end_list; z++) {
+    for (auto* z = mp->mp_current_move; z < mp->mp_end_list; z++) {
       if (pos.is_capture_move(z->move))
         z->value = capture_sort_values[pos.piece_on_square(to_square(z->move))] -
         piece_order[pos.moved_piece(z->move)] + sort_max;
@@ -133,14 +180,16 @@ namespace movepick {
     }
   }
 
-  static void insertion_sort(s_move* begin, const s_move* end) {
+  static uint64_t insertion_sort(s_move* begin, const s_move* end) {
+    uint64_t work = end - begin;
     s_move* q;
 
     for (auto* p = begin + 1; p < end; ++p) {
       auto tmp = *p;
-      for (q = p; q != begin && *(q - 1) < tmp; --q) *q = *(q - 1);
+      for (q = p; q != begin && *(q - 1) < tmp; --q, ++work) *q = *(q - 1);
       *q = tmp;
     }
+    return work;
   }
 
   static s_move* partition(s_move* begin, s_move* end, const int val) {
@@ -167,10 +216,43 @@ namespace movepick {
     }
   }
 
+#if defined(USE_AVX2)
+  static s_move* find_best_avx2(s_move* begin, const s_move* end) {
+    static_assert(sizeof(s_move) == 8, "s_move size wrong");
+    constexpr auto value_lanes = 0xAA;
+    auto best_v = _mm256_set1_epi32(INT_MIN);
+    auto* z = begin;
+    for (; z + 4 <= end; z += 4)
+      best_v = _mm256_max_epi32(best_v,
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(z)));
+
+    alignas(32) int lanes[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), best_v);
+    auto best_value = std::max(std::max(lanes[1], lanes[3]),
+      std::max(lanes[5], lanes[7]));
+    for (auto* t = z; t < end; t++) best_value = std::max(best_value, t->value);
+
+    best_v = _mm256_set1_epi32(best_value);
+    for (z = begin; z + 4 <= end; z += 4)
+      if (const auto mask = _mm256_movemask_ps(_mm256_castsi256_ps(
+        _mm256_cmpeq_epi32(best_v,
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(z))))) &
+        value_lanes)
+        return z + std::countr_zero(static_cast<unsigned>(mask)) / 2;
+    while (z->value != best_value) z++;
+    return z;
+  }
+#endif
+
   static uint32_t find_best_move(s_move* begin, const s_move* end) {
     auto* best = begin;
-    for (auto* z = begin + 1; z < end; z++)
-      if (z->value > best->value) best = z;
+#if defined(USE_AVX2)
+    if (end - begin >= 8)
+      best = find_best_avx2(begin, end);
+    else
+#endif
+      for (auto* z = begin + 1; z < end; z++)
+        if (z->value > best->value) best = z;
     const auto move = best->move;
     *best = *begin;
     return move;
@@ -192,210 +274,239 @@ namespace movepick {
     return crc;
   }
 
+  // see for the capture just picked. the first one is tested alone, so a
+  // cut node that fails high on it pays for nothing else. the second pick
+  // goes back into the slot it was taken from and one batch runs over it and
+  // the rest of the list, the hash move left out. later picks carry the
+  // see_failed bit
+  bool see_picked(const position& pos, movepick_info* mp,
+    const uint32_t picked, const int limit) {
+    if (mp->mp_see_picks == 0) {
+      mp->mp_see_picks = 1;
+      return pos.see_test(picked, limit);
+    }
+    if (mp->mp_see_picks == 1) {
+      mp->mp_see_picks = 2;
+      auto* const slot = mp->mp_current_move - 1;
+      slot->move = picked;
+      pos.see_test_all(slot, static_cast<int>(mp->mp_end_list - slot), limit,
+        mp->mp_hash_move);
+      return !(slot->move & see_failed);
+    }
+    return !(picked & see_failed);
+  }
+
   uint32_t pick_move(const position& pos) {
-    switch (auto* pi = pos.info(); pi->mp_stage) {
+    HOT_SCOPE(hot_pick_move);
+    const auto* pi = pos.info();
+    switch (auto* mp = pos.mp_info(); mp->mp_stage) {
     case normal_search:
     case check_evasions:
     case q_search_with_checks:
     case q_search_no_checks:
     case probcut:
-      pi->mp_end_list = (pi - 1)->mp_end_list;
-      ++pi->mp_stage;
-      return pi->mp_hash_move;
+      mp->mp_end_list = (mp - 1)->mp_end_list;
+      ++mp->mp_stage;
+      return mp->mp_hash_move;
 
     case gen_good_captures:
-      pi->mp_current_move = (pi - 1)->mp_end_list;
-      pi->mp_end_bad_capture = pi->mp_current_move;
-      pi->mp_delayed_number = 0;
-      pi->mp_end_list =
-        generate_moves<captures_promotions>(pos, pi->mp_current_move);
+      mp->mp_current_move = (mp - 1)->mp_end_list;
+      mp->mp_end_bad_capture = mp->mp_current_move;
+      mp->mp_delayed_number = 0;
+      mp->mp_end_list =
+        generate_moves<captures_promotions>(pos, mp->mp_current_move);
       score<captures_promotions>(pos);
-      pi->mp_stage = good_captures;
+      mp->mp_see_picks = 0;
+      mp->mp_stage = good_captures;
       [[fallthrough]];
 
     case good_captures:
-      while (pi->mp_current_move < pi->mp_end_list) {
-        if (const auto move =
-          find_best_move(pi->mp_current_move++, pi->mp_end_list);
-          move != pi->mp_hash_move) {
-          if (pos.see_test(move, see_0)) return move;
+      while (mp->mp_current_move < mp->mp_end_list) {
+        const auto picked =
+          find_best_move(mp->mp_current_move++, mp->mp_end_list);
+        if (const auto move = picked & ~see_failed; move != mp->mp_hash_move) {
+          if (see_picked(pos, mp, picked, see_0)) return move;
 
-          *pi->mp_end_bad_capture++ = move;
+          *mp->mp_end_bad_capture++ = move;
         }
       }
-      pi->mp_stage = killers_1;
+      mp->mp_stage = killers_1;
       {
         if (const auto move = pi->killers[0];
-          move && move != pi->mp_hash_move && pos.valid_move(move) &&
+          move && move != mp->mp_hash_move && pos.valid_move(move) &&
           !pos.capture_or_promotion(move))
           return move;
       }
       [[fallthrough]];
 
     case killers_1:
-      pi->mp_stage = killers_2;
+      mp->mp_stage = killers_2;
       {
         if (const auto move = pi->killers[1];
-          move && move != pi->mp_hash_move && pos.valid_move(move) &&
+          move && move != mp->mp_hash_move && pos.valid_move(move) &&
           !pos.capture_or_promotion(move))
           return move;
       }
       [[fallthrough]];
 
     case killers_2:
-      pi->mp_stage = gen_bxp_captures;
+      mp->mp_stage = gen_bxp_captures;
       {
-        if (const auto move = pi->mp_counter_move;
-          move && move != pi->mp_hash_move && move != pi->killers[0] &&
+        if (const auto move = mp->mp_counter_move;
+          move && move != mp->mp_hash_move && move != pi->killers[0] &&
           move != pi->killers[1] && pos.valid_move(move) &&
           !pos.capture_or_promotion(move))
           return move;
       }
       [[fallthrough]];
     case gen_bxp_captures:
-      pi->mp_current_move = (pi - 1)->mp_end_list;
-      pi->mp_stage = bxp_captures;
+      mp->mp_current_move = (mp - 1)->mp_end_list;
+      mp->mp_stage = bxp_captures;
       [[fallthrough]];
 
     case bxp_captures:
-      while (pi->mp_current_move < pi->mp_end_bad_capture) {
-        if (const uint32_t move = *pi->mp_current_move++;
+      while (mp->mp_current_move < mp->mp_end_bad_capture) {
+        if (const uint32_t move = *mp->mp_current_move++;
           piece_type(pos.piece_on_square(to_square(move))) == pt_knight &&
           piece_type(pos.piece_on_square(from_square(move))) == pt_bishop) {
-          *(pi->mp_current_move - 1) = no_move;
+          *(mp->mp_current_move - 1) = no_move;
           return move;
         }
       }
 
-      pi->mp_current_move = pi->mp_end_bad_capture;
-      if (pi->mp_only_quiet_check_moves && pi->move_number >= 1) {
-        auto* z = pi->mp_current_move;
+      mp->mp_current_move = mp->mp_end_bad_capture;
+      if (mp->mp_only_quiet_check_moves && pi->move_number >= 1) {
+        auto* z = mp->mp_current_move;
         z = generate_moves<quiet_checks>(pos, z);
         z = generate_moves<pawn_advances>(pos, z);
-        pi->mp_end_list = z;
+        mp->mp_end_list = z;
         score<quiet_moves>(pos);
-        insertion_sort(pi->mp_current_move, pi->mp_end_list);
+        pos.thread_info()->sort_work +=
+          insertion_sort(mp->mp_current_move, mp->mp_end_list);
       }
       else {
-        pi->mp_end_list = generate_moves<quiet_moves>(pos, pi->mp_current_move);
+        mp->mp_end_list = generate_moves<quiet_moves>(pos, mp->mp_current_move);
         score<quiet_moves>(pos);
 
-        const auto* sort_tot = pi->mp_end_list;
-        if (pi->mp_depth < 6 * plies)
-          sort_tot = partition(pi->mp_current_move, pi->mp_end_list,
-          6000 - 6000 * (pi->mp_depth / plies));
-        insertion_sort(pi->mp_current_move, sort_tot);
+        const auto* sort_tot = mp->mp_end_list;
+        if (mp->mp_depth < 6 * plies)
+          sort_tot = partition(mp->mp_current_move, mp->mp_end_list,
+          6000 - 6000 * (mp->mp_depth / plies));
+        pos.thread_info()->sort_work +=
+          insertion_sort(mp->mp_current_move, sort_tot);
       }
-      pi->mp_stage = quietmoves;
+      mp->mp_stage = quietmoves;
       [[fallthrough]];
 
     case quietmoves:
-      while (pi->mp_current_move < pi->mp_end_list) {
-        if (const uint32_t move = *pi->mp_current_move++;
-          move != pi->mp_hash_move && move != pi->killers[0] &&
-          move != pi->killers[1] && move != pi->mp_counter_move) {
+      while (mp->mp_current_move < mp->mp_end_list) {
+        if (const uint32_t move = *mp->mp_current_move++;
+          move != mp->mp_hash_move && move != pi->killers[0] &&
+          move != pi->killers[1] && move != mp->mp_counter_move) {
           return move;
         }
       }
-      pi->mp_current_move = (pi - 1)->mp_end_list;
-      pi->mp_end_list = pi->mp_end_bad_capture;
-      pi->mp_stage = bad_captures;
+      mp->mp_current_move = (mp - 1)->mp_end_list;
+      mp->mp_end_list = mp->mp_end_bad_capture;
+      mp->mp_stage = bad_captures;
       [[fallthrough]];
 
     case bad_captures:
-      while (pi->mp_current_move < pi->mp_end_list) {
-        if (const uint32_t move = *pi->mp_current_move++; move) return move;
+      while (mp->mp_current_move < mp->mp_end_list) {
+        if (const uint32_t move = *mp->mp_current_move++; move) return move;
       }
-      if (!pi->mp_delayed_number) return no_move;
+      if (!mp->mp_delayed_number) return no_move;
 
-      pi->mp_stage = delayed_moves;
-      pi->mp_delayed_current = 0;
+      mp->mp_stage = delayed_moves;
+      mp->mp_delayed_current = 0;
       [[fallthrough]];
 
     case delayed_moves:
-      if (pi->mp_delayed_current != pi->mp_delayed_number)
-        return pi->mp_delayed[pi->mp_delayed_current++];
+      if (mp->mp_delayed_current != mp->mp_delayed_number)
+        return mp->mp_delayed[mp->mp_delayed_current++];
       return no_move;
 
     case gen_check_evasions:
-      pi->mp_current_move = (pi - 1)->mp_end_list;
-      pi->mp_end_list = generate_moves<evade_check>(pos, pi->mp_current_move);
+      mp->mp_current_move = (mp - 1)->mp_end_list;
+      mp->mp_end_list = generate_moves<evade_check>(pos, mp->mp_current_move);
       score<evade_check>(pos);
-      pi->mp_stage = check_evasion_loop;
+      mp->mp_stage = check_evasion_loop;
       [[fallthrough]];
 
     case check_evasion_loop:
-      while (pi->mp_current_move < pi->mp_end_list) {
+      while (mp->mp_current_move < mp->mp_end_list) {
         if (const auto move =
-          find_best_move(pi->mp_current_move++, pi->mp_end_list);
-          move != pi->mp_hash_move)
+          find_best_move(mp->mp_current_move++, mp->mp_end_list);
+          move != mp->mp_hash_move)
           return move;
       }
       return no_move;
 
     case q_search_1:
     case q_search_2:
-      pi->mp_current_move = (pi - 1)->mp_end_list;
-      pi->mp_end_list =
-        generate_moves<captures_promotions>(pos, pi->mp_current_move);
+      mp->mp_current_move = (mp - 1)->mp_end_list;
+      mp->mp_end_list =
+        generate_moves<captures_promotions>(pos, mp->mp_current_move);
       score<captures_promotions>(pos);
-      ++pi->mp_stage;
+      ++mp->mp_stage;
       [[fallthrough]];
 
     case q_search_captures_1:
     case q_search_captures_2:
-      while (pi->mp_current_move < pi->mp_end_list) {
+      while (mp->mp_current_move < mp->mp_end_list) {
         if (const auto move =
-          find_best_move(pi->mp_current_move++, pi->mp_end_list);
-          move != pi->mp_hash_move)
+          find_best_move(mp->mp_current_move++, mp->mp_end_list);
+          move != mp->mp_hash_move)
           return move;
       }
 
-      if (pi->mp_stage == q_search_captures_2) return no_move;
+      if (mp->mp_stage == q_search_captures_2) return no_move;
 
-      pi->mp_current_move = (pi - 1)->mp_end_list;
-      pi->mp_end_list = generate_moves<quiet_checks>(pos, pi->mp_current_move);
-      ++pi->mp_stage;
+      mp->mp_current_move = (mp - 1)->mp_end_list;
+      mp->mp_end_list = generate_moves<quiet_checks>(pos, mp->mp_current_move);
+      ++mp->mp_stage;
       [[fallthrough]];
 
     case q_search_check_moves:
-      while (pi->mp_current_move < pi->mp_end_list) {
-        if (const uint32_t move = *pi->mp_current_move++;
-          move != pi->mp_hash_move)
+      while (mp->mp_current_move < mp->mp_end_list) {
+        if (const uint32_t move = *mp->mp_current_move++;
+          move != mp->mp_hash_move)
           return move;
       }
       return no_move;
 
     case gen_probcut:
-      pi->mp_current_move = (pi - 1)->mp_end_list;
-      pi->mp_end_list =
-        generate_moves<captures_promotions>(pos, pi->mp_current_move);
+      mp->mp_current_move = (mp - 1)->mp_end_list;
+      mp->mp_end_list =
+        generate_moves<captures_promotions>(pos, mp->mp_current_move);
       score<captures_promotions>(pos);
-      pi->mp_stage = probcut_captures;
+      mp->mp_see_picks = 0;
+      mp->mp_stage = probcut_captures;
       [[fallthrough]];
 
     case probcut_captures:
-      while (pi->mp_current_move < pi->mp_end_list) {
-        if (const auto move =
-          find_best_move(pi->mp_current_move++, pi->mp_end_list);
-          move != pi->mp_hash_move && pos.see_test(move, pi->mp_threshold))
-          return move;
+      while (mp->mp_current_move < mp->mp_end_list) {
+        if (const auto picked =
+          find_best_move(mp->mp_current_move++, mp->mp_end_list);
+          (picked & ~see_failed) != mp->mp_hash_move &&
+          see_picked(pos, mp, picked, mp->mp_threshold))
+          return picked & ~see_failed;
       }
       return no_move;
 
     case gen_recaptures:
-      pi->mp_current_move = (pi - 1)->mp_end_list;
-      pi->mp_end_list = generate_captures_on_square(pos, pi->mp_current_move,
-        pi->mp_capture_square);
+      mp->mp_current_move = (mp - 1)->mp_end_list;
+      mp->mp_end_list = generate_captures_on_square(pos, mp->mp_current_move,
+        mp->mp_capture_square);
       score<captures_promotions>(pos);
-      pi->mp_stage = recapture_moves;
+      mp->mp_stage = recapture_moves;
       [[fallthrough]];
 
     case recapture_moves:
-      while (pi->mp_current_move < pi->mp_end_list) {
+      while (mp->mp_current_move < mp->mp_end_list) {
         if (const auto move =
-          find_best_move(pi->mp_current_move++, pi->mp_end_list);
-          to_square(move) == pi->mp_capture_square)
+          find_best_move(mp->mp_current_move++, mp->mp_end_list);
+          to_square(move) == mp->mp_capture_square)
           return move;
       }
       return no_move;
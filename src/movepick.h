@@ -60,6 +60,10 @@ struct piece_square_stats : piece_square_table<int16_t> {
     return *(reinterpret_cast<const int16_t*>(table_) + offset);
   }
 
+  [[nodiscard]] const int16_t* values() const {
+    return reinterpret_cast<const int16_t*>(table_);
+  }
+
   void fill(const int val) {
     const auto vv =
       static_cast<uint16_t>(val) << 16 | static_cast<uint16_t>(val);
@@ -115,10 +119,13 @@ private:
   uint16_t table_[num_sides][64 * 64] = {};
 };
 
+// indexed by the 12 real pieces and 6 piece types rather than the 16 and 8
+// ptype values, which keeps the table at 576 KB instead of 1 MB. both moves
+// are real moves whenever search reads or writes it
 struct counter_follow_up_move_stats {
   uint32_t get(const ptype piece1, const square to1, const ptype piece2,
     const square to2) {
-    return table_[piece1][to1][piece_type(piece2)][to2];
+    return table_[piece_index(piece1)][to1][piece_type(piece2) - 1][to2];
   }
 
   void clear() {
@@ -127,27 +134,42 @@ struct counter_follow_up_move_stats {
 
   void update(const ptype piece1, const square to1, const ptype piece2,
     const square to2, const uint32_t move) {
-    table_[piece1][to1][piece_type(piece2)][to2] = static_cast<uint16_t>(move);
+    table_[piece_index(piece1)][to1][piece_type(piece2) - 1][to2] =
+      static_cast<uint16_t>(move);
   }
 private:
-  uint16_t table_[num_pieces][num_squares][num_piecetypes][num_squares] = {};
+  static int piece_index(const ptype piece) {
+    return 6 * (piece >> 3) + (piece & 7) - 1;
+  }
+
+  uint16_t table_[12][num_squares][6][num_squares] = {};
 };
 
 struct max_gain_stats {
+  static int calculate_offset(const ptype piece, const uint32_t move) {
+    return 64 * 64 * static_cast<int>(piece) + static_cast<int>(move & 0x0fff);
+  }
+
   [[nodiscard]] int get(const ptype piece, const uint32_t move) const {
     return table_[piece][move & 0x0fff];
   }
 
+  [[nodiscard]] const int16_t* values() const {
+    return &table_[0][0];
+  }
+
   void clear() {
     std::memset(table_, 0, sizeof table_);
   }
 
+  // gains are clamped to +-500 by the caller, so the running average fits
   void update(const ptype piece, const uint32_t move, const int gain) {
     auto* const p_gain = &table_[piece][move & 0x0fff];
-    *p_gain += (gain - *p_gain + 8) >> 4;
+    *p_gain = static_cast<int16_t>(*p_gain + ((gain - *p_gain + 8) >> 4));
   }
 private:
-  int table_[num_pieces][64 * 64] = {};
+  int16_t table_[num_pieces][64 * 64] = {};
+  int16_t gather_pad_{};
 };
 
 struct killer_stats {
@@ -172,7 +194,14 @@ private:
 using counter_move_stats = piece_square_table<uint16_t>;
 using move_value_stats = piece_square_stats<8192, 8192>;
 using counter_move_values = piece_square_stats<3 * 8192, 3 * 8192>;
-using counter_move_history = piece_square_table<counter_move_values>;
+static_assert(sizeof(counter_move_values) == 2048, "counter_move_values size wrong");
+
+// one pad at the end, so gather_int16 on the last entry of the last table
+// stays inside. the tables themselves keep their 64-byte alignment
+struct counter_move_history : piece_square_table<counter_move_values> {
+private:
+  int16_t gather_pad_{};
+};
 
 inline stage& operator++(stage& d) {
   return d = static_cast<stage>(static_cast<int>(d) + 1);
@@ -1,7 +1,12 @@
 #include "nnue.h"
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cstdio>
 #include <cstring>
+#include <iterator>
+#include <new>
+#include <thread>
 #include "main.h"
 #include "util.h"
 
@@ -71,42 +76,75 @@ static int orient(const int c, const int s) {
   return s ^ (c == white ? 0x00 : 0x3f);
 }
 
-static unsigned make_index(const int c, const int s, const int pc,
-  const int ksq) {
-  return orient(c, s) + piece_to_index[c][pc] + ps_end * ksq;
-}
+// feature sets: map a piece on a square, seen from one perspective, to a
+// feature transformer input. king_context() folds the own king square into
+// whatever the set needs, so it is computed once per perspective.
+struct halfkp_features {
+  static constexpr feature_set id = halfkp;
+  static constexpr unsigned dimensions = 64 * ps_end;
+  static constexpr bool includes_kings = false;
 
-static void half_kp_append_active_indices(const board* pos, const int c,
-  index_list* active) {
-  int ksq = pos->squares[c];
-  ksq = orient(c, ksq);
-  for (int i = 2; pos->pieces[i]; i++) {
-    const int sq = pos->squares[i];
-    const int pc = pos->pieces[i];
-    active->values[active->size++] = make_index(c, sq, pc, ksq);
+  static unsigned king_context(const int c, const int ksq) {
+    return orient(c, ksq);
+  }
+
+  static unsigned index(const int c, const int s, const int pc,
+    const unsigned ctx) {
+    return orient(c, s) + piece_to_index[c][pc] + ps_end * ctx;
+  }
+};
+
+// king-relative piece squares including both kings: the board is flipped for
+// black and mirrored so the own king stands on files e-h, the king square
+// then selects one of 32 buckets
+struct halfka_v2_features {
+  static constexpr feature_set id = halfka_v2;
+  static constexpr unsigned piece_squares = 11 * 64;
+  static constexpr unsigned king_buckets = 32;
+  static constexpr unsigned dimensions = piece_squares * king_buckets;
+  static constexpr bool includes_kings = true;
+
+  static constexpr uint16_t piece_index[2][14] = {
+    {0, 640, 512, 384, 256, 128, 0, 640, 576, 448, 320, 192, 64, 0},
+    {0, 640, 576, 448, 320, 192, 64, 640, 512, 384, 256, 128, 0, 0}
+  };
+
+  static unsigned king_context(const int c, const int ksq) {
+    const unsigned flip = (c == white ? 0x00 : 0x38) ^ ((ksq & 7) < 4 ? 7 : 0);
+    const unsigned k = ksq ^ flip;
+    return flip | ((k >> 3) * 4 + (k & 7) - 4) << 6;
+  }
+
+  static unsigned index(const int c, const int s, const int pc,
+    const unsigned ctx) {
+    return (s ^ (ctx & 63)) + piece_index[c][pc] + piece_squares * (ctx >> 6);
   }
+};
+
+template <typename F>
+static void append_active_indices(const board* pos, const int c,
+  index_list* active) {
+  const auto ctx = F::king_context(c, pos->squares[c]);
+  for (int i = F::includes_kings ? 0 : 2; pos->pieces[i]; i++)
+    active->values[active->size++] =
+    F::index(c, pos->squares[i], pos->pieces[i], ctx);
 }
 
-static void half_kp_append_changed_indices(const board* pos, const int c,
-  const dirty_piece* dp, index_list* removed,
-  index_list* added) {
-  int ksq = pos->squares[c];
-  ksq = orient(c, ksq);
+template <typename F>
+static void append_changed_indices(const board* pos, const int c,
+  const dirty_piece* dp, index_list* removed, index_list* added) {
+  const auto ctx = F::king_context(c, pos->squares[c]);
   for (int i = 0; i < dp->dirty_num; i++) {
     const int pc = dp->pc[i];
-    if (IS_KING(pc)) continue;
+    if (!F::includes_kings && IS_KING(pc)) continue;
     if (dp->from[i] != 64)
-      removed->values[removed->size++] = make_index(c, dp->from[i], pc, ksq);
+      removed->values[removed->size++] = F::index(c, dp->from[i], pc, ctx);
     if (dp->to[i] != 64)
-      added->values[added->size++] = make_index(c, dp->to[i], pc, ksq);
+      added->values[added->size++] = F::index(c, dp->to[i], pc, ctx);
   }
 }
 
-static void append_active_indices(const board* pos, index_list active[2]) {
-  for (unsigned c = 0; c < 2; c++)
-    half_kp_append_active_indices(pos, c, &active[c]);
-}
-
+template <typename F>
 static void append_changed_indices(const board* pos, index_list removed[2],
   index_list added[2], bool reset[2]) {
   const dirty_piece* dp = &pos->nnue[0]->dirty_piece;
@@ -114,9 +152,9 @@ static void append_changed_indices(const board* pos, index_list removed[2],
     for (unsigned c = 0; c < 2; c++) {
       reset[c] = dp->pc[0] == static_cast<int>(KING(c));
       if (reset[c])
-        half_kp_append_active_indices(pos, c, &added[c]);
+        append_active_indices<F>(pos, c, &added[c]);
       else
-        half_kp_append_changed_indices(pos, c, dp, &removed[c], &added[c]);
+        append_changed_indices<F>(pos, c, dp, &removed[c], &added[c]);
     }
   }
   else {
@@ -125,21 +163,71 @@ static void append_changed_indices(const board* pos, index_list removed[2],
       reset[c] = dp->pc[0] == static_cast<int>(KING(c)) ||
         dp2->pc[0] == static_cast<int>(KING(c));
       if (reset[c])
-        half_kp_append_active_indices(pos, c, &added[c]);
+        append_active_indices<F>(pos, c, &added[c]);
       else {
-        half_kp_append_changed_indices(pos, c, dp, &removed[c], &added[c]);
-        half_kp_append_changed_indices(pos, c, dp2, &removed[c], &added[c]);
+        append_changed_indices<F>(pos, c, dp, &removed[c], &added[c]);
+        append_changed_indices<F>(pos, c, dp2, &removed[c], &added[c]);
       }
     }
   }
 }
 
+// network architecture: feature set, transformer half width and the widths of
+// the two hidden layers, every kernel below is instantiated per arch
+template <typename F, unsigned HalfDims, unsigned L1, unsigned L2>
+struct arch {
+  using features = F;
+  static constexpr unsigned half_dims = HalfDims;
+  static constexpr unsigned ft_out = 2 * HalfDims;
+  static constexpr unsigned l1 = L1;
+  static constexpr unsigned l2 = L2;
+  static constexpr unsigned num_regs = HalfDims / 16 < 16 ? HalfDims / 16 : 16;
+  static constexpr unsigned tile_height = num_regs * 16;
+  static constexpr arch_desc desc{ F::id, HalfDims, L1, L2 };
+
+  static_assert(HalfDims <= max_half_dimensions && HalfDims % tile_height == 0);
+  static_assert(L1 % 32 == 0 && L2 % 32 == 0);
+
+  // weights after conversion: first hidden layer in affine_sparse order, the
+  // second in wt_idx order with its biases permuted for the avx2 unpack
+  // order, ready to use in place
+  struct network {
+    alignas(64) int16_t ft_biases[HalfDims];
+    alignas(64) int16_t ft_weights[HalfDims * F::dimensions];
+    alignas(64) int32_t hidden1_biases[L1];
+    alignas(64) weight_t hidden1_weights[L1 * ft_out];
+    alignas(64) int32_t hidden2_biases[L2];
+    alignas(64) weight_t hidden2_weights[L2 * L1];
+    alignas(64) int32_t output_biases[1];
+    alignas(64) weight_t output_weights[L2];
+  };
+
+  struct buffers {
+    alignas(64) clipped_t input[ft_out];
+    alignas(32) clipped_t hidden1_out[L1];
+    alignas(32) int8_t hidden2_out[L2];
+  };
+
+  // size of the body of a legacy .nnue file behind its description
+  static constexpr size_t legacy_size = 4 + 2 * HalfDims +
+    2 * static_cast<size_t>(HalfDims) * F::dimensions + 4 + 4 * L1 +
+    L1 * ft_out + 4 * L2 + L2 * L1 + 4 + L2;
+};
+
+using halfkp_256x2_32_32 = arch<halfkp_features, 256, 32, 32>;
+using halfkp_128x2_32_32 = arch<halfkp_features, 128, 32, 32>;
+using halfka_v2_512x2_32_32 = arch<halfka_v2_features, 512, 32, 32>;
+
+template <unsigned InDims>
 static int32_t affine_propagate(clipped_t* input, const int32_t* biases,
-  weight_t* weights) {
+  const weight_t* weights) {
   const auto iv = reinterpret_cast<__m256i*>(input);
-  const auto row = reinterpret_cast<__m256i*>(weights);
-  __m256i prod = _mm256_maddubs_epi16(iv[0], row[0]);
-  prod = _mm256_madd_epi16(prod, _mm256_set1_epi16(1));
+  const auto row = reinterpret_cast<const __m256i*>(weights);
+  __m256i prod = _mm256_madd_epi16(_mm256_maddubs_epi16(iv[0], row[0]),
+    _mm256_set1_epi16(1));
+  for (unsigned i = 1; i < InDims / 32; i++)
+    prod = _mm256_add_epi32(prod, _mm256_madd_epi16(
+      _mm256_maddubs_epi16(iv[i], row[i]), _mm256_set1_epi16(1)));
   __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(prod),
     _mm256_extracti128_si256(prod, 1));
   sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x1b));
@@ -158,82 +246,185 @@ static bool next_idx(unsigned* idx, unsigned* offset, mask2_t* v, mask_t* mask,
   return true;
 }
 
-static void affine_txfm(int8_t* input, void* output, unsigned in_dims,
-  unsigned out_dims, const int32_t* biases,
-  const weight_t* weights, mask_t* in_mask,
-  mask_t* out_mask, const bool pack8_and_calc_mask) {
-  assert(out_dims == 32);
-  (void)out_dims;
+// one block of 32 outputs per pass, the weights of a block are laid out
+// input by input (wt_idx)
+template <unsigned InDims, unsigned OutDims>
+static void affine_txfm(int8_t* input, void* output, const int32_t* biases,
+  const weight_t* weights, mask_t* in_mask, mask_t* out_mask,
+  const bool pack8_and_calc_mask) {
   const __m256i k_zero = _mm256_setzero_si256();
-  __m256i out_0 = ((__m256i*)biases)[0];
-  __m256i out_1 = ((__m256i*)biases)[1];
-  __m256i out_2 = ((__m256i*)biases)[2];
-  __m256i out_3 = ((__m256i*)biases)[3];
-  __m256i first, second;
-  mask2_t v;
-  unsigned idx;
-  memcpy(&v, in_mask, sizeof(mask2_t));
-  for (unsigned offset = 0; offset < in_dims;) {
-    if (!next_idx(&idx, &offset, &v, in_mask, in_dims)) break;
-    first = ((__m256i*)weights)[idx];
-    uint16_t factor = input[idx];
-    if (next_idx(&idx, &offset, &v, in_mask, in_dims)) {
-      second = ((__m256i*)weights)[idx];
-      factor |= input[idx] << 8;
-    }
-    else {
-      second = k_zero;
+  for (unsigned b = 0; b < OutDims / 32; b++) {
+    const auto* block_biases = reinterpret_cast<const __m256i*>(biases + 32 * b);
+    const auto* block_weights =
+      reinterpret_cast<const __m256i*>(weights) + b * InDims;
+    __m256i out_0 = block_biases[0];
+    __m256i out_1 = block_biases[1];
+    __m256i out_2 = block_biases[2];
+    __m256i out_3 = block_biases[3];
+    __m256i first, second;
+    mask2_t v;
+    unsigned idx;
+    memcpy(&v, in_mask, sizeof(mask2_t));
+    for (unsigned offset = 0; offset < InDims;) {
+      if (!next_idx(&idx, &offset, &v, in_mask, InDims)) break;
+      first = block_weights[idx];
+      uint16_t factor = input[idx];
+      if (next_idx(&idx, &offset, &v, in_mask, InDims)) {
+        second = block_weights[idx];
+        factor |= input[idx] << 8;
+      }
+      else {
+        second = k_zero;
+      }
+      __m256i mul = _mm256_set1_epi16(factor), prod, signs;
+      prod = _mm256_maddubs_epi16(mul, _mm256_unpacklo_epi8(first, second));
+      signs = _mm256_cmpgt_epi16(k_zero, prod);
+      out_0 = _mm256_add_epi32(out_0, _mm256_unpacklo_epi16(prod, signs));
+      out_1 = _mm256_add_epi32(out_1, _mm256_unpackhi_epi16(prod, signs));
+      prod = _mm256_maddubs_epi16(mul, _mm256_unpackhi_epi8(first, second));
+      signs = _mm256_cmpgt_epi16(k_zero, prod);
+      out_2 = _mm256_add_epi32(out_2, _mm256_unpacklo_epi16(prod, signs));
+      out_3 = _mm256_add_epi32(out_3, _mm256_unpackhi_epi16(prod, signs));
     }
-    __m256i mul = _mm256_set1_epi16(factor), prod, signs;
-    prod = _mm256_maddubs_epi16(mul, _mm256_unpacklo_epi8(first, second));
-    signs = _mm256_cmpgt_epi16(k_zero, prod);
-    out_0 = _mm256_add_epi32(out_0, _mm256_unpacklo_epi16(prod, signs));
-    out_1 = _mm256_add_epi32(out_1, _mm256_unpackhi_epi16(prod, signs));
-    prod = _mm256_maddubs_epi16(mul, _mm256_unpackhi_epi8(first, second));
-    signs = _mm256_cmpgt_epi16(k_zero, prod);
-    out_2 = _mm256_add_epi32(out_2, _mm256_unpacklo_epi16(prod, signs));
-    out_3 = _mm256_add_epi32(out_3, _mm256_unpackhi_epi16(prod, signs));
-  }
-  __m256i out16_0 = _mm256_srai_epi16(_mm256_packs_epi32(out_0, out_1), shift_);
-  __m256i out16_1 = _mm256_srai_epi16(_mm256_packs_epi32(out_2, out_3), shift_);
-  auto out_vec = static_cast<__m256i*>(output);
-  out_vec[0] = _mm256_packs_epi16(out16_0, out16_1);
-  if (pack8_and_calc_mask)
-    out_mask[0] = _mm256_movemask_epi8(_mm256_cmpgt_epi8(out_vec[0], k_zero));
-  else
-    out_vec[0] = _mm256_max_epi8(out_vec[0], k_zero);
+    __m256i out16_0 =
+      _mm256_srai_epi16(_mm256_packs_epi32(out_0, out_1), shift_);
+    __m256i out16_1 =
+      _mm256_srai_epi16(_mm256_packs_epi32(out_2, out_3), shift_);
+    auto out_vec = static_cast<__m256i*>(output) + b;
+    out_vec[0] = _mm256_packs_epi16(out16_0, out16_1);
+    if (pack8_and_calc_mask)
+      out_mask[b] =
+      _mm256_movemask_epi8(_mm256_cmpgt_epi8(out_vec[0], k_zero));
+    else
+      out_vec[0] = _mm256_max_epi8(out_vec[0], k_zero);
+  }
+}
+
+// first hidden layer over the non-zero 4-byte chunks of the transformed
+// input only. the weights of a chunk are stored output by output, 4 bytes
+// each, so one broadcast of the chunk feeds 8 outputs per register
+template <unsigned InDims, unsigned OutDims>
+static void affine_sparse(const clipped_t* input, int8_t* output,
+  const int32_t* biases, const weight_t* weights, const uint16_t* nnz,
+  const unsigned nnz_count, mask_t* out_mask) {
+  constexpr unsigned num_regs = OutDims / 8;
+  const __m256i k_zero = _mm256_setzero_si256();
+  const __m256i k_ones = _mm256_set1_epi16(1);
+  const auto* in32 = reinterpret_cast<const int32_t*>(input);
+#ifdef FAT_BINARY
+  // transform fills input with vector stores. flattened into the isa clones
+  // gcc loses track of them and warns that in32 may be read uninitialised,
+  // hiding where in32 points ends that without emitting any code
+  asm("" : "+r"(in32));
+#endif
+  const auto* columns = reinterpret_cast<const __m256i*>(weights);
+  __m256i acc[num_regs];
+  for (unsigned j = 0; j < num_regs; j++)
+    acc[j] = reinterpret_cast<const __m256i*>(biases)[j];
+  for (unsigned k = 0; k < nnz_count; k++) {
+    const __m256i in = _mm256_set1_epi32(in32[nnz[k]]);
+    const __m256i* column = columns + nnz[k] * num_regs;
+    for (unsigned j = 0; j < num_regs; j++)
+      acc[j] = _mm256_add_epi32(acc[j], _mm256_madd_epi16(
+        _mm256_maddubs_epi16(in, column[j]), k_ones));
+  }
+  // the two packs interleave 128-bit lanes, the permute restores output order
+  const __m256i k_order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  for (unsigned b = 0; b < OutDims / 32; b++) {
+    const __m256i out16_0 = _mm256_srai_epi16(
+      _mm256_packs_epi32(acc[4 * b], acc[4 * b + 1]), shift_);
+    const __m256i out16_1 = _mm256_srai_epi16(
+      _mm256_packs_epi32(acc[4 * b + 2], acc[4 * b + 3]), shift_);
+    const __m256i out = _mm256_permutevar8x32_epi32(
+      _mm256_packs_epi16(out16_0, out16_1), k_order);
+    reinterpret_cast<__m256i*>(output)[b] = out;
+    out_mask[b] = _mm256_movemask_epi8(_mm256_cmpgt_epi8(out, k_zero));
+  }
 }
 
-static int16_t ft_biases alignas(64)[k_half_dimensions];
-static int16_t ft_weights alignas(64)[k_half_dimensions * ft_in_dims];
+// steps between prefetching a weight column and adding it
+enum : uint8_t { column_prefetch_distance = 2 };
 
-static void refresh_accumulator(const board* pos) {
-  Accumulator* accumulator = &pos->nnue[0]->accumulator;
-  index_list active_indices[2];
-  active_indices[0].size = active_indices[1].size = 0;
-  append_active_indices(pos, active_indices);
+// both perspectives of every tile in one pass over a single column list:
+// per perspective the removed columns, then the added ones. while a column
+// is applied the one column_prefetch_distance steps ahead, possibly in the
+// next perspective or tile, is requested, since ft_weights does not fit in
+// cache. a perspective in reset starts from the biases, with no removed
+template <typename A>
+static void update_tiles(const typename A::network* n,
+  Accumulator* accumulator, const Accumulator* prev_acc,
+  const index_list removed[2], const index_list added[2],
+  const bool reset[2]) {
+  constexpr unsigned tiles = A::half_dims / A::tile_height;
+  constexpr unsigned column_lines = A::tile_height * sizeof(int16_t) / 64;
+  size_t columns[4 * std::size(index_list{}.values)];
+  unsigned removed_end[2], added_end[2], count = 0;
   for (unsigned c = 0; c < 2; c++) {
-    for (unsigned i = 0; i < k_half_dimensions / TILE_HEIGHT; i++) {
-      const vec16_t* ft_biases_tile =
-        reinterpret_cast<vec16_t*>(&ft_biases[i * TILE_HEIGHT]);
+    for (size_t k = 0; k < removed[c].size; k++)
+      columns[count++] =
+      static_cast<size_t>(A::half_dims) * removed[c].values[k];
+    removed_end[c] = count;
+    for (size_t k = 0; k < added[c].size; k++)
+      columns[count++] =
+      static_cast<size_t>(A::half_dims) * added[c].values[k];
+    added_end[c] = count;
+  }
+  const auto prefetch_step = [&](const unsigned step) {
+    if (step >= tiles * count) return;
+    const int16_t* column = &n->ft_weights[columns[step % count] +
+      step / count * A::tile_height];
+    for (unsigned l = 0; l < column_lines; l++)
+      prefetch(const_cast<int16_t*>(column) + l * 32);
+  };
+  for (unsigned step = 0; step < column_prefetch_distance; step++)
+    prefetch_step(step);
+
+  for (unsigned i = 0; i < tiles; i++) {
+    unsigned g = 0;
+    for (unsigned c = 0; c < 2; c++) {
       const auto acc_tile = reinterpret_cast<vec16_t*>(
-        &accumulator->accumulation[c][i * TILE_HEIGHT]);
-      vec16_t acc[num_regs];
-      for (unsigned j = 0; j < num_regs; j++) acc[j] = ft_biases_tile[j];
-      for (size_t k = 0; k < active_indices[c].size; k++) {
-        const unsigned index = active_indices[c].values[k];
-        const unsigned offset = k_half_dimensions * index + i * TILE_HEIGHT;
-        const vec16_t* column = reinterpret_cast<vec16_t*>(&ft_weights[offset]);
-        for (unsigned j = 0; j < num_regs; j++)
+        &accumulator->accumulation[c][i * A::tile_height]);
+      const auto* start_tile = reinterpret_cast<const vec16_t*>(reset[c]
+        ? &n->ft_biases[i * A::tile_height]
+        : &prev_acc->accumulation[c][i * A::tile_height]);
+      vec16_t acc[A::num_regs];
+      for (unsigned j = 0; j < A::num_regs; j++) acc[j] = start_tile[j];
+      for (; g < removed_end[c]; g++) {
+        prefetch_step(i * count + g + column_prefetch_distance);
+        const auto* column = reinterpret_cast<const vec16_t*>(
+          &n->ft_weights[columns[g] + i * A::tile_height]);
+        for (unsigned j = 0; j < A::num_regs; j++)
+          acc[j] = VEC_SUB_16(acc[j], column[j]);
+      }
+      for (; g < added_end[c]; g++) {
+        prefetch_step(i * count + g + column_prefetch_distance);
+        const auto* column = reinterpret_cast<const vec16_t*>(
+          &n->ft_weights[columns[g] + i * A::tile_height]);
+        for (unsigned j = 0; j < A::num_regs; j++)
           acc[j] = VEC_ADD_16(acc[j], column[j]);
       }
-      for (unsigned j = 0; j < num_regs; j++) acc_tile[j] = acc[j];
+      for (unsigned j = 0; j < A::num_regs; j++) acc_tile[j] = acc[j];
     }
   }
   accumulator->computed_accumulation = 1;
 }
 
-static bool update_accumulator(const board* pos) {
+template <typename A>
+static void refresh_accumulator(const typename A::network* n,
+  const board* pos) {
+  index_list removed_indices[2], active_indices[2];
+  removed_indices[0].size = removed_indices[1].size = 0;
+  active_indices[0].size = active_indices[1].size = 0;
+  for (unsigned c = 0; c < 2; c++)
+    append_active_indices<typename A::features>(pos, c, &active_indices[c]);
+  constexpr bool reset[2] = { true, true };
+  update_tiles<A>(n, &pos->nnue[0]->accumulator, nullptr, removed_indices,
+    active_indices, reset);
+}
+
+template <typename A>
+static bool update_accumulator(const typename A::network* n,
+  const board* pos) {
   Accumulator* accumulator = &pos->nnue[0]->accumulator;
   if (accumulator->computed_accumulation) return true;
   Accumulator* prev_acc;
@@ -246,108 +437,154 @@ static bool update_accumulator(const board* pos) {
   removed_indices[0].size = removed_indices[1].size = 0;
   added_indices[0].size = added_indices[1].size = 0;
   bool reset[2];
-  append_changed_indices(pos, removed_indices, added_indices, reset);
-  for (unsigned i = 0; i < k_half_dimensions / TILE_HEIGHT; i++) {
-    for (unsigned c = 0; c < 2; c++) {
-      const auto acc_tile = reinterpret_cast<vec16_t*>(
-        &accumulator->accumulation[c][i * TILE_HEIGHT]);
-      vec16_t acc[num_regs];
-      if (reset[c]) {
-        const vec16_t* ft_b_tile =
-          reinterpret_cast<vec16_t*>(&ft_biases[i * TILE_HEIGHT]);
-        for (unsigned j = 0; j < num_regs; j++) acc[j] = ft_b_tile[j];
-      }
-      else {
-        const vec16_t* prev_acc_tile = reinterpret_cast<vec16_t*>(
-          &prev_acc->accumulation[c][i * TILE_HEIGHT]);
-        for (unsigned j = 0; j < num_regs; j++) acc[j] = prev_acc_tile[j];
-        for (unsigned k = 0; k < removed_indices[c].size; k++) {
-          const unsigned index = removed_indices[c].values[k];
-          const unsigned offset = k_half_dimensions * index + i * TILE_HEIGHT;
-          const vec16_t* column =
-            reinterpret_cast<vec16_t*>(&ft_weights[offset]);
-          for (unsigned j = 0; j < num_regs; j++)
-            acc[j] = VEC_SUB_16(acc[j], column[j]);
-        }
-      }
-      for (unsigned k = 0; k < added_indices[c].size; k++) {
-        const unsigned index = added_indices[c].values[k];
-        const unsigned offset = k_half_dimensions * index + i * TILE_HEIGHT;
-        const vec16_t* column = reinterpret_cast<vec16_t*>(&ft_weights[offset]);
-        for (unsigned j = 0; j < num_regs; j++)
-          acc[j] = VEC_ADD_16(acc[j], column[j]);
-      }
-      for (unsigned j = 0; j < num_regs; j++) acc_tile[j] = acc[j];
-    }
-  }
-  accumulator->computed_accumulation = 1;
+  append_changed_indices<typename A::features>(pos, removed_indices,
+    added_indices, reset);
+  update_tiles<A>(n, accumulator, prev_acc, removed_indices, added_indices,
+    reset);
   return true;
 }
 
-static void transform(const board* pos, clipped_t* output, mask_t* out_mask) {
-  if (!update_accumulator(pos)) refresh_accumulator(pos);
-  int16_t(*accumulation)[2][256] = &pos->nnue[0]->accumulator.accumulation;
-  (void)out_mask;
+// writes the clipped transformer output and collects the indices of its
+// non-zero 4-byte chunks, returns how many there are
+template <typename A>
+static unsigned transform(const typename A::network* n, const board* pos,
+  clipped_t* output, uint16_t* nnz) {
+  if (!update_accumulator<A>(n, pos)) refresh_accumulator<A>(n, pos);
+  auto& accumulation = pos->nnue[0]->accumulator.accumulation;
   const int perspectives[2] = { pos->player, !pos->player };
+  const __m256i k_zero = _mm256_setzero_si256();
+  unsigned nnz_count = 0;
   for (unsigned p = 0; p < 2; p++) {
-    const unsigned offset = k_half_dimensions * p;
-    constexpr unsigned num_chunks = 16 * k_half_dimensions / simd_width;
+    const unsigned offset = A::half_dims * p;
     const auto out = reinterpret_cast<vec8_t*>(&output[offset]);
-    for (unsigned i = 0; i < num_chunks / 2; i++) {
-      const vec16_t s0 =
-        reinterpret_cast<vec16_t*>((*accumulation)[perspectives[p]])[i * 2];
-      const vec16_t s1 = reinterpret_cast<vec16_t*>(
-        (*accumulation)[perspectives[p]])[i * 2 + 1];
-      out[i] = VEC_PACKS(s0, s1);
-      *out_mask++ = VEC_MASK_POS(out[i]);
+    const auto* acc =
+      reinterpret_cast<const vec16_t*>(accumulation[perspectives[p]]);
+    for (unsigned i = 0; i < A::half_dims / 32; i++) {
+      out[i] = _mm256_max_epi8(VEC_PACKS(acc[i * 2], acc[i * 2 + 1]), k_zero);
+      auto nz = static_cast<unsigned>(_mm256_movemask_ps(
+        _mm256_castsi256_ps(_mm256_cmpgt_epi32(out[i], k_zero))));
+      const unsigned chunk = (offset + i * 32) / 4;
+      for (; nz; nz &= nz - 1)
+        nnz[nnz_count++] = static_cast<uint16_t>(chunk + lsb(nz));
     }
   }
+  return nnz_count;
 }
 
-int nnue_evaluate_pos(const board* pos) {
-  alignas(8) mask_t input_mask[ft_out_dims / (8 * sizeof(mask_t))];
-  alignas(8) mask_t hidden1_mask[8 / sizeof(mask_t)] = {};
-  net_data buf;
+template <typename A>
+ISA_CLONES
+static int evaluate_pos(const void* weights, const board* pos) {
+  const auto* n = static_cast<const typename A::network*>(weights);
+  alignas(64) uint16_t nnz[A::ft_out / 4];
+  // next_idx reads the mask 64 bits at a time
+  alignas(8) mask_t hidden1_mask[(A::l1 / 32 + 1) & ~1u] = {};
+  typename A::buffers buf;
 #define B(x) (buf.x)
-  transform(pos, B(input), input_mask);
-  affine_txfm(B(input), B(hidden1_out), ft_out_dims, 32, hidden1_biases,
-    hidden1_weights, input_mask, hidden1_mask, true);
-  affine_txfm(B(hidden1_out), B(hidden2_out), 32, 32, hidden2_biases,
-    hidden2_weights, hidden1_mask, nullptr, false);
-  const int32_t out_value =
-    affine_propagate(B(hidden2_out), output_biases, output_weights);
+  const unsigned nnz_count = transform<A>(n, pos, B(input), nnz);
+  affine_sparse<A::ft_out, A::l1>(B(input), B(hidden1_out), n->hidden1_biases,
+    n->hidden1_weights, nnz, nnz_count, hidden1_mask);
+  affine_txfm<A::l1, A::l2>(B(hidden1_out), B(hidden2_out), n->hidden2_biases,
+    n->hidden2_weights, hidden1_mask, nullptr, false);
+  const int32_t out_value = affine_propagate<A::l2>(B(hidden2_out),
+    n->output_biases, n->output_weights);
+#undef B
   return out_value / fv_scale;
 }
 
-static unsigned wt_idx(const unsigned r, unsigned c, const unsigned dims) {
-  (void)dims;
-  if (dims > 32) {
-    unsigned b = c & 0x18;
-    b = b << 1 | b >> 1;
-    c = (c & ~0x18) | (b & 0x18);
+// times the first hidden layer of one position, once over the non-zero
+// chunks of its input and once over all of them
+template <typename A>
+ISA_CLONES
+static void bench_first_layer(const void* weights, const board* pos,
+  const int reps, nnue_l1_sample* s) {
+  const auto* n = static_cast<const typename A::network*>(weights);
+  constexpr unsigned chunks = A::ft_out / 4;
+  alignas(64) uint16_t nnz[chunks], every[chunks];
+  alignas(8) mask_t hidden1_mask[(A::l1 / 32 + 1) & ~1u] = {};
+  typename A::buffers buf;
+  const unsigned nnz_count = transform<A>(n, pos, buf.input, nnz);
+  for (unsigned i = 0; i < chunks; i++) every[i] = static_cast<uint16_t>(i);
+  s->density = static_cast<double>(nnz_count) / chunks;
+
+  volatile int8_t sink = 0;
+  for (unsigned pass = 0; pass < 2; pass++) {
+    const auto run = [&] {
+      affine_sparse<A::ft_out, A::l1>(buf.input, buf.hidden1_out,
+        n->hidden1_biases, n->hidden1_weights, pass ? nnz : every,
+        pass ? nnz_count : chunks, hidden1_mask);
+    };
+    run();  // warm the weights into cache
+    const auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; r++) {
+      run();
+      sink = sink + buf.hidden1_out[r % A::l1];
+    }
+    const auto elapsed = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count();
+    (pass ? s->sparse_ns : s->dense_ns) = elapsed / reps;
   }
-  return c * 32 + r;
 }
 
-const static char* read_hidden_weights(weight_t* w, const unsigned dims,
-  const char* d) {
-  for (unsigned r = 0; r < 32; r++)
+template <typename A>
+ISA_CLONES
+static void refresh_net(const void* weights, const board* pos) {
+  refresh_accumulator<A>(static_cast<const typename A::network*>(weights),
+    pos);
+}
+
+template <typename A>
+ISA_CLONES
+static bool update_net(const void* weights, const board* pos) {
+  return update_accumulator<A>(
+    static_cast<const typename A::network*>(weights), pos);
+}
+
+// inputs coming from transform() are in packs_epi16 lane order, which swaps
+// bits 3 and 4 of the input index
+static unsigned packed_pos(const unsigned c) {
+  unsigned b = c & 0x18;
+  b = b << 1 | b >> 1;
+  return (c & ~0x18) | (b & 0x18);
+}
+
+// output r of a hidden layer lives in block r / 32, inside a block the
+// weights are stored input by input
+static size_t wt_idx(const unsigned r, const unsigned c, const unsigned dims) {
+  return static_cast<size_t>(r / 32) * dims * 32 + c * 32 + r % 32;
+}
+
+const static char* read_hidden_weights(weight_t* w, const unsigned rows,
+  const unsigned dims, const char* d) {
+  for (unsigned r = 0; r < rows; r++)
     for (unsigned c = 0; c < dims; c++) w[wt_idx(r, c, dims)] = *d++;
   return d;
 }
 
-static void permute_biases(int32_t* biases) {
-  const auto b = reinterpret_cast<__m128i*>(biases);
-  __m128i tmp[8];
-  tmp[0] = b[0];
-  tmp[1] = b[4];
-  tmp[2] = b[1];
-  tmp[3] = b[5];
-  tmp[4] = b[2];
-  tmp[5] = b[6];
-  tmp[6] = b[3];
-  tmp[7] = b[7];
-  memcpy(b, tmp, 8 * sizeof(__m128i));
+// affine_sparse order: 4-byte input chunk, then output, then input in chunk
+const static char* read_sparse_weights(weight_t* w, const unsigned rows,
+  const unsigned dims, const char* d) {
+  for (unsigned r = 0; r < rows; r++)
+    for (unsigned c = 0; c < dims; c++) {
+      const unsigned p = packed_pos(c);
+      w[static_cast<size_t>(p / 4) * rows * 4 + r * 4 + p % 4] = *d++;
+    }
+  return d;
+}
+
+static void permute_biases(int32_t* biases, const unsigned count) {
+  for (unsigned block = 0; block < count / 32; block++) {
+    const auto b = reinterpret_cast<__m128i*>(biases + 32 * block);
+    __m128i tmp[8];
+    tmp[0] = b[0];
+    tmp[1] = b[4];
+    tmp[2] = b[1];
+    tmp[3] = b[5];
+    tmp[4] = b[2];
+    tmp[5] = b[6];
+    tmp[6] = b[3];
+    tmp[7] = b[7];
+    memcpy(b, tmp, 8 * sizeof(__m128i));
+  }
 }
 
 static uint32_t readu_le_u32(const void* p) {
@@ -360,74 +597,490 @@ static uint16_t readu_le_u16(const void* p) {
   return q[0] | q[1] << 8;
 }
 
-static void read_output_weights(weight_t* w, const char* d) {
-  for (unsigned i = 0; i < 32; i++) {
-    const unsigned c = i;
-    w[c] = *d++;
-  }
+static void read_output_weights(weight_t* w, const unsigned dims,
+  const char* d) {
+  for (unsigned i = 0; i < dims; i++) w[i] = *d++;
+}
+
+// converts the body of a legacy .nnue file (behind the description)
+template <typename A>
+static void init_weights(void* weights, const char* d) {
+  auto* n = static_cast<typename A::network*>(weights);
+  d += 4;
+  for (unsigned i = 0; i < A::half_dims; i++, d += 2)
+    n->ft_biases[i] = readu_le_u16(d);
+  for (size_t i = 0; i < static_cast<size_t>(A::half_dims) *
+    A::features::dimensions; i++, d += 2)
+    n->ft_weights[i] = readu_le_u16(d);
+  d += 4;
+  for (unsigned i = 0; i < A::l1; i++, d += 4)
+    n->hidden1_biases[i] = readu_le_u32(d);
+  d = read_sparse_weights(n->hidden1_weights, A::l1, A::ft_out, d);
+  for (unsigned i = 0; i < A::l2; i++, d += 4)
+    n->hidden2_biases[i] = readu_le_u32(d);
+  d = read_hidden_weights(n->hidden2_weights, A::l2, A::l1, d);
+  for (unsigned i = 0; i < 1; i++, d += 4) n->output_biases[i] = readu_le_u32(d);
+  read_output_weights(n->output_weights, A::l2, d);
+  permute_biases(n->hidden2_biases, A::l2);
 }
 
-static bool verify_net(const void* eval_data, const size_t size) {
-  if (size != 21022697) return false;
+// everything the loader needs to know about one compiled architecture
+struct arch_entry {
+  arch_desc desc;
+  size_t size;
+  size_t legacy_size;
+  uint32_t legacy_hashes[3];
+  int (*evaluate)(const void* weights, const board* pos);
+  void (*convert)(void* weights, const char* legacy_body);
+  void (*bench_l1)(const void* weights, const board* pos, int reps,
+    nnue_l1_sample* s);
+  void (*refresh)(const void* weights, const board* pos);
+  bool (*update)(const void* weights, const board* pos);
+};
+
+template <typename A>
+static constexpr arch_entry entry_of(const uint32_t arch_hash = 0,
+  const uint32_t ft_hash = 0, const uint32_t net_hash = 0) {
+  return { A::desc, sizeof(typename A::network), A::legacy_size,
+    { arch_hash, ft_hash, net_hash }, evaluate_pos<A>, init_weights<A>,
+    bench_first_layer<A>, refresh_net<A>, update_net<A> };
+}
+
+// the shipped net comes first, legacy hashes are only known (and checked)
+// for it
+static constexpr arch_entry arch_entries[] = {
+  entry_of<halfkp_256x2_32_32>(0x3e5aa6ee, 0x5d69d7b8, 0x63337156),
+  entry_of<halfkp_128x2_32_32>(),
+  entry_of<halfka_v2_512x2_32_32>()
+};
+
+// a legacy file: version, architecture hash, description, then the body
+static const arch_entry* verify_net(const void* eval_data, const size_t size) {
+  if (size < 12) return nullptr;
   const auto d = static_cast<const char*>(eval_data);
-  if (readu_le_u32(d) != nnue_version) return false;
-  if (readu_le_u32(d + 4) != 0x3e5aa6eeU) return false;
-  if (readu_le_u32(d + 8) != 177) return false;
-  if (readu_le_u32(d + transformer_start) != 0x5d69d7b8) return false;
-  if (readu_le_u32(d + network_start) != 0x63337156) return false;
-  return true;
+  if (readu_le_u32(d) != nnue_version) return nullptr;
+  const size_t transformer_start = 12 + static_cast<size_t>(readu_le_u32(d + 8));
+  for (const auto& e : arch_entries) {
+    if (size != transformer_start + e.legacy_size) continue;
+    const size_t network_start = transformer_start + e.legacy_size -
+      (4 + 4 * e.desc.l1 + e.desc.l1 * 2 * e.desc.half_dims + 4 * e.desc.l2 +
+        e.desc.l2 * e.desc.l1 + 4 + e.desc.l2);
+    if (e.legacy_hashes[0] && (readu_le_u32(d + 4) != e.legacy_hashes[0] ||
+      readu_le_u32(d + transformer_start) != e.legacy_hashes[1] ||
+      readu_le_u32(d + network_start) != e.legacy_hashes[2]))
+      continue;
+    return &e;
+  }
+  return nullptr;
 }
 
-static void init_weights(const void* eval_data) {
-  const char* d = static_cast<const char*>(eval_data) + transformer_start + 4;
-  for (unsigned i = 0; i < k_half_dimensions; i++, d += 2)
-    ft_biases[i] = readu_le_u16(d);
-  for (unsigned i = 0; i < k_half_dimensions * ft_in_dims; i++, d += 2)
-    ft_weights[i] = readu_le_u16(d);
-  d += 4;
-  for (unsigned i = 0; i < 32; i++, d += 4) hidden1_biases[i] = readu_le_u32(d);
-  d = read_hidden_weights(hidden1_weights, 512, d);
-  for (unsigned i = 0; i < 32; i++, d += 4) hidden2_biases[i] = readu_le_u32(d);
-  d = read_hidden_weights(hidden2_weights, 32, d);
-  for (unsigned i = 0; i < 1; i++, d += 4) output_biases[i] = readu_le_u32(d);
-  read_output_weights(output_weights, d);
-  permute_biases(hidden1_biases);
-  permute_biases(hidden2_biases);
+static const arch_entry* native_arch(const void* data, const size_t size) {
+  if (size < sizeof(native_net_header)) return nullptr;
+  const auto* header = static_cast<const native_net_header*>(data);
+  if (header->magic != native_net_magic ||
+    header->layout != native_net_layout ||
+    header->source_version != nnue_version)
+    return nullptr;
+  for (const auto& e : arch_entries)
+    if (e.desc == header->arch && header->size == e.size &&
+      size == sizeof(native_net_header) + e.size)
+      return &e;
+  return nullptr;
+}
+
+// a network and the storage behind it: converted into memory, or a native
+// file or shared segment mapped and used in place
+struct loaded_net {
+  const arch_entry* arch{};
+  const void* weights{};
+  void* memory{};
+  const void* mapped_data{};
+  map_t mapping{};
+};
+
+// evaluation reads net only, it changes between searches in nnue_publish()
+static std::atomic<const loaded_net*> net;
+static loaded_net* active_net;
+static std::atomic<loaded_net*> pending_net;
+static std::thread loader;
+
+static void release_net(const loaded_net* ln) {
+  if (!ln) return;
+  if (ln->mapped_data) unmap_file(ln->mapped_data, ln->mapping);
+  if (ln->memory) ::operator delete(ln->memory, std::align_val_t{ 64 });
+  delete ln;
+}
+
+static void write_native_header(native_net_header* header,
+  const arch_entry* e) {
+  header->layout = native_net_layout;
+  header->size = e->size;
+  header->source_version = nnue_version;
+  header->arch = e->desc;
 }
 
-static bool load_eval_file(const char* eval_file) {
+#ifndef _WIN32
+// names the shared segment without reading the net: device, inode, size and
+// mtime of the net file, or of the engine binary for the embedded net
+static uint64_t shared_net_key(const struct stat& st) {
+  const uint64_t parts[] = { native_net_layout, static_cast<uint64_t>(st.st_dev),
+    static_cast<uint64_t>(st.st_ino), static_cast<uint64_t>(st.st_size),
+    static_cast<uint64_t>(st.st_mtime) };
+  uint64_t key = 0xcbf29ce484222325ull;
+  const auto* bytes = reinterpret_cast<const uint8_t*>(parts);
+  for (size_t i = 0; i < sizeof parts; i++)
+    key = (key ^ bytes[i]) * 0x100000001b3ull;
+  return key;
+}
+
+// converted weights in a named posix shared memory segment. the process that
+// finds the segment without a valid header converts into it while holding an
+// exclusive flock, later processes take the lock and map it read-only. a
+// creator that dies mid-conversion loses its lock with it, so the next start
+// sees no magic and converts again. the segment outlives the processes, so
+// following engine starts skip the conversion too (rm /dev/shm/fire-net-*)
+static bool shared_net(const uint64_t key, const char* legacy_body,
+  loaded_net* ln) {
+  char name[40];
+  snprintf(name, sizeof name, "/fire-net-%016llx",
+    static_cast<unsigned long long>(key));
+  const size_t segment_size = sizeof(native_net_header) + ln->arch->size;
+
+  // a segment created by another user can still be used read-only
+  auto writable = true;
+  int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    writable = false;
+    fd = shm_open(name, O_RDONLY, 0);
+  }
+  if (fd < 0) return false;
+
+  // wait up to 10 s for a live creator to finish the conversion
+  auto locked = false;
+  for (auto i = 0; i < 10000 && !((locked = flock(fd,
+    (writable ? LOCK_EX : LOCK_SH) | LOCK_NB) == 0)); ++i)
+    usleep(1000);
+  if (!locked) {
+    close(fd);
+    return false;
+  }
+
+  void* data = MAP_FAILED;
+  struct stat st{};
+  if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == segment_size) {
+    data = mmap(nullptr, segment_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data != MAP_FAILED && native_arch(data, segment_size) != ln->arch) {
+      munmap(data, segment_size);
+      data = MAP_FAILED;
+    }
+  }
+
+  // a new segment, or one left without magic by a creator that died
+  if (data == MAP_FAILED && writable &&
+    ftruncate(fd, 0) == 0 &&
+    ftruncate(fd, static_cast<off_t>(segment_size)) == 0 &&
+    (data = mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+      fd, 0)) != MAP_FAILED) {
+    auto* header = static_cast<native_net_header*>(data);
+    ln->arch->convert(header + 1, legacy_body);
+    write_native_header(header, ln->arch);
+    header->magic = native_net_magic;
+    mprotect(data, segment_size, PROT_READ);
+  }
+
+  flock(fd, LOCK_UN);
+  close(fd);
+  if (data == MAP_FAILED) return false;
+  ln->weights = static_cast<const native_net_header*>(data) + 1;
+  ln->mapped_data = data;
+  ln->mapping = segment_size;
+  return true;
+}
+#endif
+
+static loaded_net* load_eval_file(const char* eval_file, const bool shared) {
   const void* eval_data;
   map_t mapping;
   size_t size;
+#ifndef _WIN32
+  struct stat identity{};
+#endif
 #if !defined(_MSC_VER) && defined(NNUE_EMBEDDED)
   if (strcmp(eval_file, NNUE_EVAL_FILE) == 0) {
     eval_data = gNetworkData;
     mapping = 0;
     size = gNetworkSize;
+#ifndef _WIN32
+    stat("/proc/self/exe", &identity);
+#endif
   }
   else
 #endif
   {
     const FD fd = open_file(eval_file);
-    if (fd == FD_ERR) return false;
+    if (fd == FD_ERR) return nullptr;
     eval_data = map_file(fd, &mapping);
     size = file_size(fd);
+#ifndef _WIN32
+    fstat(fd, &identity);
+#endif
     close_file(fd);
   }
-  const bool success = verify_net(eval_data, size);
-  if (success) init_weights(eval_data);
+  if (!eval_data) return nullptr;
+
+  auto* ln = new loaded_net;
+
+  // a native net is used straight from the mapping, no copy
+  if ((ln->arch = native_arch(eval_data, size))) {
+    ln->weights = static_cast<const native_net_header*>(eval_data) + 1;
+    ln->mapped_data = mapping ? eval_data : nullptr;
+    ln->mapping = mapping;
+    return ln;
+  }
+
+  const auto* d = static_cast<const char*>(eval_data);
+  if (!((ln->arch = verify_net(eval_data, size)))) {
+    delete ln;
+    ln = nullptr;
+  }
+#ifndef _WIN32
+  else if (shared && identity.st_ino &&
+    shared_net(shared_net_key(identity), d + size - ln->arch->legacy_size,
+      ln)) {
+  }
+#else
+  (void)shared;
+#endif
+  else {
+    ln->memory = ::operator new(ln->arch->size, std::align_val_t{ 64 });
+    ln->arch->convert(ln->memory, d + size - ln->arch->legacy_size);
+    ln->weights = ln->memory;
+  }
   if (mapping) unmap_file(eval_data, mapping);
-  return success;
+  return ln;
 }
 
-int nnue_init(const char* eval_file) {
-  if (load_eval_file(eval_file))
+int nnue_init(const char* eval_file, const bool shared) {
+  if (auto* ln = load_eval_file(eval_file, shared)) {
+    release_net(active_net);
+    active_net = ln;
+    net.store(ln, std::memory_order_release);
     acout() << "NNUE loaded" << std::endl;
+  }
   else
     acout() << "NNUE not found" << std::endl;
   return fflush(stdout);
 }
 
+// loads and verifies a net on a background thread, the search keeps using
+// the active net until nnue_publish() swaps the new one in
+void nnue_load(const std::string& eval_file, const bool shared) {
+  if (loader.joinable()) loader.join();
+  loader = std::thread([eval_file, shared] {
+    if (auto* ln = load_eval_file(eval_file.c_str(), shared)) {
+      release_net(pending_net.exchange(ln, std::memory_order_acq_rel));
+      acout() << "info string EvalFile " << eval_file
+        << " verified, active from the next search" << std::endl;
+    }
+    else
+      acout() << "info string EvalFile " << eval_file
+      << " not found or invalid, keeping the current net" << std::endl;
+    });
+}
+
+// called while no search runs: the old net has no readers left
+void nnue_publish() {
+  if (auto* ln = pending_net.exchange(nullptr, std::memory_order_acq_rel)) {
+    net.store(ln, std::memory_order_release);
+    release_net(active_net);
+    active_net = ln;
+  }
+}
+
+void nnue_exit() {
+  if (loader.joinable()) loader.join();
+  release_net(pending_net.exchange(nullptr));
+  release_net(active_net);
+  active_net = nullptr;
+  net = nullptr;
+}
+
+// writes the active network in the native format, which later loads are
+// able to map and use without conversion
+int nnue_convert(const char* out_file) {
+  const auto* ln = net.load(std::memory_order_relaxed);
+  if (!ln) {
+    acout() << "info string no network loaded" << std::endl;
+    return 1;
+  }
+  FILE* f = fopen(out_file, "wb");
+  if (!f) {
+    acout() << "info string cannot write " << out_file << std::endl;
+    return 1;
+  }
+  native_net_header header{};
+  header.magic = native_net_magic;
+  write_native_header(&header, ln->arch);
+  const bool ok = fwrite(&header, sizeof header, 1, f) == 1 &&
+    fwrite(ln->weights, ln->arch->size, 1, f) == 1;
+  fclose(f);
+  acout() << "info string " << (ok ? "native net written to " : "failed to write ")
+    << out_file << std::endl;
+  return ok ? fflush(stdout) : 1;
+}
+
+static int evaluate_with(const loaded_net* ln, const nnue_position& p) {
+  nnue_data nnue;
+  nnue.accumulator.computed_accumulation = 0;
+  board pos;
+  pos.nnue[0] = &nnue;
+  pos.nnue[1] = nullptr;
+  pos.nnue[2] = nullptr;
+  pos.player = p.player;
+  pos.pieces = const_cast<int*>(p.pieces);
+  pos.squares = const_cast<int*>(p.squares);
+  return ln->arch->evaluate(ln->weights, &pos);
+}
+
+// evaluates the positions with the active net and with the net in
+// eval_file, e.g. the same net in another format
+bool nnue_compare(const char* eval_file, const nnue_position* positions,
+  const int count, nnue_compare_sample* s) {
+  const auto* ln = net.load(std::memory_order_relaxed);
+  const loaded_net* other = ln ? load_eval_file(eval_file, false) : nullptr;
+  if (!other) return false;
+  *s = nnue_compare_sample{};
+  double sum = 0;
+  for (int i = 0; i < count; i++) {
+    const int diff = std::abs(evaluate_with(ln, positions[i]) -
+      evaluate_with(other, positions[i]));
+    sum += diff;
+    s->max_abs = std::max(s->max_abs, diff);
+    if (diff > 10) s->over_10++;
+  }
+  s->mean_abs = count ? sum / count : 0;
+  release_net(other);
+  return true;
+}
+
+int nnue_evaluate_pos(const board* pos) {
+  const auto* ln = net.load(std::memory_order_relaxed);
+  return ln ? ln->arch->evaluate(ln->weights, pos) : 0;
+}
+
+bool nnue_bench_l1(const int player, int* pieces, int* squares, const int reps,
+  nnue_l1_sample* s) {
+  const auto* ln = net.load(std::memory_order_relaxed);
+  if (!ln) return false;
+  nnue_data nnue;
+  nnue.accumulator.computed_accumulation = 0;
+  board pos;
+  pos.nnue[0] = &nnue;
+  pos.nnue[1] = nullptr;
+  pos.nnue[2] = nullptr;
+  pos.player = player;
+  pos.pieces = pieces;
+  pos.squares = squares;
+  ln->arch->bench_l1(ln->weights, &pos, reps, s);
+  return true;
+}
+
+// the dirty pieces of the move from a to b: the king first if it moved, a
+// piece leaving the board goes to 64, a promoted one comes from 64
+static void diff_positions(const nnue_position& a, const nnue_position& b,
+  dirty_piece* dp) {
+  int on_a[64]{}, on_b[64]{};
+  bool arrived[64]{};
+  for (int i = 0; a.pieces[i]; i++) on_a[a.squares[i]] = a.pieces[i];
+  for (int i = 0; b.pieces[i]; i++) on_b[b.squares[i]] = b.pieces[i];
+  dp->dirty_num = 0;
+  for (int sq = 0; sq < 64; sq++) {
+    if (!on_a[sq] || on_a[sq] == on_b[sq]) continue;
+    int to = 64;
+    for (int t = 0; t < 64 && to == 64; t++)
+      if (on_b[t] == on_a[sq] && on_a[t] != on_b[t] && !arrived[t]) to = t;
+    if (to != 64) arrived[to] = true;
+    const int d = dp->dirty_num++;
+    dp->pc[d] = on_a[sq];
+    dp->from[d] = sq;
+    dp->to[d] = to;
+    if (IS_KING(dp->pc[d]) && d) {
+      std::swap(dp->pc[0], dp->pc[d]);
+      std::swap(dp->from[0], dp->from[d]);
+      std::swap(dp->to[0], dp->to[d]);
+    }
+  }
+  for (int sq = 0; sq < 64; sq++) {
+    if (!on_b[sq] || on_a[sq] == on_b[sq] || arrived[sq]) continue;
+    const int d = dp->dirty_num++;
+    dp->pc[d] = on_b[sq];
+    dp->from[d] = 64;
+    dp->to[d] = sq;
+  }
+}
+
+// times incremental accumulator updates from each parent to its child and
+// full refreshes of the children, over all pairs per pass so the weight
+// columns come from memory rather than from the previous repetition
+bool nnue_bench_accumulator(const nnue_position* parents,
+  const nnue_position* children, const int count, const int passes,
+  nnue_update_sample* s) {
+  const auto* ln = net.load(std::memory_order_relaxed);
+  if (!ln || count <= 0) return false;
+  auto* data = new nnue_data[3 * static_cast<size_t>(count)];
+  const auto make_board = [&](const nnue_position& p, nnue_data* n0,
+    nnue_data* n1) {
+    board pos;
+    pos.nnue[0] = n0;
+    pos.nnue[1] = n1;
+    pos.nnue[2] = nullptr;
+    pos.player = p.player;
+    pos.pieces = const_cast<int*>(p.pieces);
+    pos.squares = const_cast<int*>(p.squares);
+    return pos;
+  };
+  for (int i = 0; i < count; i++) {
+    data[3 * i].accumulator.computed_accumulation = 0;
+    const board parent = make_board(parents[i], &data[3 * i], nullptr);
+    ln->arch->refresh(ln->weights, &parent);
+    diff_positions(parents[i], children[i], &data[3 * i + 1].dirty_piece);
+  }
+
+  double update_ns = 0, refresh_ns = 0;
+  for (int pass = 0; pass < passes; pass++) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+      data[3 * i + 1].accumulator.computed_accumulation = 0;
+      const board child =
+        make_board(children[i], &data[3 * i + 1], &data[3 * i]);
+      ln->arch->update(ln->weights, &child);
+    }
+    auto end = std::chrono::steady_clock::now();
+    update_ns += std::chrono::duration<double, std::nano>(end - start).count();
+    start = end;
+    for (int i = 0; i < count; i++) {
+      const board child = make_board(children[i], &data[3 * i + 2], nullptr);
+      ln->arch->refresh(ln->weights, &child);
+    }
+    end = std::chrono::steady_clock::now();
+    refresh_ns += std::chrono::duration<double, std::nano>(end - start).count();
+  }
+
+  s->update_ns = update_ns / passes / count;
+  s->refresh_ns = refresh_ns / passes / count;
+  s->mismatches = 0;
+  const size_t half_bytes = ln->arch->desc.half_dims * sizeof(int16_t);
+  for (int i = 0; i < count; i++)
+    for (unsigned c = 0; c < 2; c++)
+      if (memcmp(data[3 * i + 1].accumulator.accumulation[c],
+        data[3 * i + 2].accumulator.accumulation[c], half_bytes)) {
+        s->mismatches++;
+        break;
+      }
+  delete[] data;
+  return true;
+}
+
 int nnue_evaluate(const int player, int* pieces, int* squares) {
   nnue_data nnue;
   nnue.accumulator.computed_accumulation = 0;
@@ -4,7 +4,10 @@
 #include <string>
 #include <cstdint>
 #else
+#include <fcntl.h>
+#include <sys/file.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #endif
 
@@ -42,7 +45,6 @@ typedef size_t map_t;
 #define IS_64BIT 1
 #endif
 
-#define TILE_HEIGHT (num_regs * simd_width / 16)
 #define CLAMP(a, b, c) ((a) < (b) ? (b) : (a) > (c) ? (c) : (a))
 
 #if !defined(_MSC_VER)
@@ -84,16 +86,21 @@ enum : uint16_t {
 };
 enum : uint8_t { fv_scale = 16, shift_ = 6 };
 
-enum : uint16_t {
-  k_half_dimensions = 256,
-  ft_in_dims = 64 * ps_end,
-  ft_out_dims = k_half_dimensions * 2
-};
-enum : uint16_t { num_regs = 16, simd_width = 256 };
+// largest feature transformer half the accumulator has room for
+enum : uint16_t { max_half_dimensions = 512 };
+
+// input feature sets a network file can describe
+enum feature_set : uint32_t { halfkp = 1, halfka_v2 = 2 };
 
-enum {
-  transformer_start = 3 * 4 + 177,
-  network_start = transformer_start + 4 + 2 * 256 + 2 * 256 * 64 * 641
+// the architecture a network file describes in its header, evaluation is
+// dispatched to the kernels compiled for exactly this shape
+struct arch_desc {
+  uint32_t features;
+  uint32_t half_dims;
+  uint32_t l1;
+  uint32_t l2;
+
+  constexpr bool operator==(const arch_desc&) const = default;
 };
 
 using dirty_piece = struct dirty_piece {
@@ -104,7 +111,7 @@ using dirty_piece = struct dirty_piece {
 };
 
 using Accumulator = struct Accumulator {
-  alignas(64) int16_t accumulation[2][256];
+  alignas(64) int16_t accumulation[2][max_half_dimensions];
   int computed_accumulation;
 };
 
@@ -129,21 +136,28 @@ using weight_t = int8_t;
 
 using index_list = struct {
   size_t size;
-  unsigned values[30];
+  unsigned values[32];
 };
 
 #define VEC_ADD_16(a, b) _mm256_add_epi16(a, b)
 #define VEC_SUB_16(a, b) _mm256_sub_epi16(a, b)
 #define VEC_PACKS(a, b) _mm256_packs_epi16(a, b)
-#define VEC_MASK_POS(a) \
-  _mm256_movemask_epi8(_mm256_cmpgt_epi8(a, _mm256_setzero_si256()))
 
-static weight_t output_weights alignas(64)[1 * 32];
-static int32_t hidden1_biases alignas(64)[32];
-static int32_t hidden2_biases alignas(64)[32];
-static int32_t output_biases[1];
-static weight_t hidden1_weights alignas(64)[64 * 512];
-static weight_t hidden2_weights alignas(64)[64 * 32];
+// a native net file is a native_net_header followed by the converted
+// network of the described architecture (see nnue.cpp), 64-byte aligned so
+// it can be mapped and used in place
+static constexpr uint32_t native_net_magic = 0x454E4946u;  // "FINE"
+static constexpr uint32_t native_net_layout = 3;
+
+struct native_net_header {
+  uint32_t magic;
+  uint32_t layout;
+  uint64_t size;
+  uint32_t source_version;
+  arch_desc arch;
+  uint8_t reserved[28];
+};
+static_assert(sizeof(native_net_header) == 64);
 
 inline uint32_t piece_to_index[2][14] = {
   {
@@ -156,15 +170,48 @@ inline uint32_t piece_to_index[2][14] = {
   }
 };
 
-struct net_data {
-  alignas(64) clipped_t input[ft_out_dims];
-  clipped_t hidden1_out[32];
-  int8_t hidden2_out[32];
+// first hidden layer cost of one position, see nnuebench
+struct nnue_l1_sample {
+  double density;
+  double dense_ns;
+  double sparse_ns;
+};
+
+// a position in the piece and square list layout of nnue_evaluate()
+struct nnue_position {
+  int player;
+  int pieces[33];
+  int squares[33];
+};
+
+// accumulator cost of parent to child moves, see nnuebench
+struct nnue_update_sample {
+  double update_ns;
+  double refresh_ns;
+  int mismatches;
+};
+
+// evaluation differences between two nets, see nnuecheck
+struct nnue_compare_sample {
+  double mean_abs;
+  int max_abs;
+  int over_10;
 };
 
 int nnue_evaluate_pos(const board* pos);
-int nnue_init(const char* eval_file);
+int nnue_init(const char* eval_file, bool shared);
+void nnue_load(const std::string& eval_file, bool shared);
+void nnue_publish();
+void nnue_exit();
+int nnue_convert(const char* out_file);
 int nnue_evaluate(int player, int* pieces, int* squares);
+bool nnue_bench_l1(int player, int* pieces, int* squares, int reps,
+  nnue_l1_sample* s);
+bool nnue_bench_accumulator(const nnue_position* parents,
+  const nnue_position* children, int count, int passes,
+  nnue_update_sample* s);
+bool nnue_compare(const char* eval_file, const nnue_position* positions,
+  int count, nnue_compare_sample* s);
 FD open_file(const char* name);
 void close_file(FD fd);
 size_t file_size(FD fd);
@@ -1,5 +1,9 @@
 #pragma once
+#include <cstdint>
 #include <string>
 
+class position;
+
+uint64_t start_perft(position& pos, int depth);
 int perft(int depth, std::string& fen);
 int divide(int depth, const std::string& fen);
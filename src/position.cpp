@@ -7,6 +7,7 @@
 #include "macro.h"
 #include "main.h"
 #include "movegen.h"
+#include "profile.h"
 #include "thread.h"
 #include "util.h"
 #include "zobrist.h"
@@ -32,6 +33,7 @@ void position::calculate_bishop_color_key() const {
 void position::calculate_check_pins() const {
   calculate_pins<white>();
   calculate_pins<black>();
+  pin_info_->attacks.valid = false;
   const auto square_k = king(~on_move_);
   pos_info_->check_squares[pt_pawn] = attack_from<pt_pawn>(square_k, ~on_move_);
   pos_info_->check_squares[pt_knight] = attack_from<pt_knight>(square_k);
@@ -42,6 +44,27 @@ void position::calculate_check_pins() const {
   pos_info_->check_squares[pt_king] = 0;
 }
 
+void position::calculate_king_danger() const {
+  const auto you = ~on_move_;
+  const auto occupied = pieces() ^ pieces(on_move_, pt_king);
+  const auto pawns = pieces(you, pt_pawn);
+
+  auto result = you == white
+    ? shift_bb<north_east>(pawns) | shift_bb<north_west>(pawns)
+    : shift_bb<south_east>(pawns) | shift_bb<south_west>(pawns);
+  result |= empty_attack[pt_king][king(you)];
+
+  for (auto b = pieces(you, pt_knight); b;)
+    result |= empty_attack[pt_knight][pop_lsb(&b)];
+  for (auto b = pieces(you, pt_bishop, pt_queen); b;)
+    result |= attack_bishop_bb(pop_lsb(&b), occupied);
+  for (auto b = pieces(you, pt_rook, pt_queen); b;)
+    result |= attack_rook_bb(pop_lsb(&b), occupied);
+
+  pin_info_->attacks.king_danger = result;
+  pin_info_->attacks.valid = true;
+}
+
 template <side color>
 void position::calculate_pins() const {
   uint64_t result = 0;
@@ -57,10 +80,10 @@ void position::calculate_pins() const {
     if (const auto b = get_between(square_k, sq) & pieces();
       b && !more_than_one(b)) {
       result |= b;
-      pos_info_->pin_by[lsb(b)] = sq;
+      pin_info_->pin_by[lsb(b)] = sq;
     }
   }
-  pos_info_->x_ray[color] = result;
+  pin_info_->x_ray[color] = result;
 }
 
 square position::calculate_threat() const {
@@ -125,6 +148,28 @@ square position::calculate_threat() const {
   return no_square;
 }
 
+// game moves are never taken back, so once the history below the root
+// reaches max_game_history only the plies the repetition check can still
+// look at (draw50_moves is below 100 whenever it looks) are kept
+void position::trim_history() {
+  constexpr auto keep = 101;
+  static_assert(keep < max_game_history);
+
+  auto* const base = thread_info_->position_inf + 5;
+  if (pos_info_ - base < max_game_history - 1) return;
+
+  std::memmove(base, pos_info_ - (keep - 1), keep * sizeof(position_info));
+  pos_info_ = base + keep - 1;
+  const auto ply = pos_info_ - thread_info_->position_inf;
+  thread_info_->pin_inf[ply] = *pin_info_;
+  pin_info_ = thread_info_->pin_inf + ply;
+  mp_info_ = thread_info_->movepick_inf + ply;
+#ifdef COPY_MAKE
+  thread_info_->board_stack[0] = *board_state_;
+  board_state_ = thread_info_->board_stack;
+#endif
+}
+
 void position::copy_position(const position* pos, thread* th,
   const position_info* copy_state) {
   std::memcpy(this, pos, sizeof(position));
@@ -146,6 +191,15 @@ void position::copy_position(const position* pos, thread* th,
       orig_st++;
     }
     pos_info_--;
+
+    const auto ply = pos_info_ - th->ti->position_inf;
+    mp_info_ = th->ti->movepick_inf + ply;
+    pin_info_ = th->ti->pin_inf + ply;
+#ifdef COPY_MAKE
+    board_state_ = th->ti->board_stack;
+    *board_state_ = *pos->board_state_;
+#endif
+    calculate_check_pins();
   }
 }
 
@@ -165,7 +219,7 @@ bool position::give_check(const uint32_t move) const {
   if (pos_info_->check_squares[piece_type(piece_on_square(from))] & to)
     return true;
 
-  if (pos_info_->x_ray[~on_move_] & from && !aligned(from, to, square_k))
+  if (pin_info_->x_ray[~on_move_] & from && !aligned(from, to, square_k))
     return true;
 
   if (move < static_cast<uint32_t>(castle_move)) return false;
@@ -193,24 +247,26 @@ bool position::give_check(const uint32_t move) const {
 }
 
 void position::init() {
+  prng rng(1070372);
+
   for (auto color = white; color <= black; ++color)
     for (auto piece = pt_king; piece <= pt_queen; ++piece)
       for (auto sq = a1; sq <= h8; ++sq)
-        zobrist::psq[make_piece(color, piece)][sq] = random::rand<uint64_t>();
+        zobrist::psq[make_piece(color, piece)][sq] = rng.rand<uint64_t>();
 
   for (auto f = file_a; f <= file_h; ++f)
-    zobrist::enpassant[f] = random::rand<uint64_t>();
+    zobrist::enpassant[f] = rng.rand<uint64_t>();
 
   for (int castle = no_castle; castle <= all; ++castle) {
     zobrist::castle[castle] = 0;
     uint64_t b = castle;
     while (b) {
       const auto k = zobrist::castle[1ULL << pop_lsb(&b)];
-      zobrist::castle[castle] ^= k ? k : random::rand<uint64_t>();
+      zobrist::castle[castle] ^= k ? k : rng.rand<uint64_t>();
     }
   }
 
-  zobrist::on_move = random::rand<uint64_t>();
+  zobrist::on_move = rng.rand<uint64_t>();
   init_hash_move50(50);
 }
 
@@ -284,9 +340,9 @@ bool position::legal_move(const uint32_t move) const {
 
   if (piece_type(piece_on_square(from)) == pt_king)
     return move_type(move) == castle_move ||
-    !(attack_to(to_square(move)) & pieces(~me));
+    !(king_danger() & to_square(move));
 
-  return !(pos_info_->x_ray[on_move_] & from) ||
+  return !(pin_info_->x_ray[on_move_] & from) ||
     aligned(from, to_square(move), king(me));
 }
 
@@ -305,7 +361,7 @@ void position::do_castle_move(const side me, const square from, const square to,
   else {
     delete_piece(me, make_piece(me, pt_king), yes ? from : to);
     delete_piece(me, make_piece(me, pt_rook), yes ? from_r : to_r);
-    board_[yes ? from : to] = board_[yes ? from_r : to_r] = no_piece;
+    board_state_->board[yes ? from : to] = board_state_->board[yes ? from_r : to_r] = no_piece;
     move_piece(me, make_piece(me, pt_king), yes ? to : from);
     move_piece(me, make_piece(me, pt_rook), yes ? to_r : from_r);
   }
@@ -323,13 +379,20 @@ void position::play_move(const uint32_t move) {
 }
 
 void position::play_move(const uint32_t move, const bool gives_check) {
+  HOT_SCOPE(hot_play_move);
   assert(is_ok(move));
 
+#ifdef COPY_MAKE
+  board_state_[1] = board_state_[0];
+  ++board_state_;
+#endif
   ++nodes_;
   auto key = pos_info_->key ^ zobrist::on_move;
 
   std::memcpy(pos_info_ + 1, pos_info_, offsetof(position_info, key));
   pos_info_++;
+  mp_info_++;
+  pin_info_++;
 
   pos_info_->draw50_moves = (pos_info_ - 1)->draw50_moves + 1;
   pos_info_->distance_to_null_move = (pos_info_ - 1)->distance_to_null_move + 1;
@@ -373,7 +436,7 @@ void position::play_move(const uint32_t move, const bool gives_check) {
         assert(piece_on_square(to) == no_piece);
         assert(piece_on_square(capture_square) == make_piece(you, pt_pawn));
 
-        board_[capture_square] = no_piece;
+        board_state_->board[capture_square] = no_piece;
       }
 
       pos_info_->pawn_key ^= zobrist::psq[capture_piece][capture_square];
@@ -387,7 +450,7 @@ void position::play_move(const uint32_t move, const bool gives_check) {
 
     key ^= zobrist::psq[capture_piece][capture_square];
     pos_info_->material_key ^=
-      zobrist::psq[capture_piece][piece_number_[capture_piece]];
+      zobrist::psq[capture_piece][board_state_->piece_number[capture_piece]];
 
     if (piece_type(capture_piece) == pt_bishop) calculate_bishop_color_key();
 
@@ -430,8 +493,8 @@ void position::play_move(const uint32_t move, const bool gives_check) {
       key ^= zobrist::psq[piece][to] ^ zobrist::psq[promotion][to];
       pos_info_->pawn_key ^= zobrist::psq[piece][to];
       pos_info_->material_key ^=
-        zobrist::psq[promotion][piece_number_[promotion] - 1] ^
-        zobrist::psq[piece][piece_number_[piece]];
+        zobrist::psq[promotion][board_state_->piece_number[promotion] - 1] ^
+        zobrist::psq[piece][board_state_->piece_number[piece]];
 
       if (piece_type(promotion) == pt_bishop) calculate_bishop_color_key();
 
@@ -443,9 +506,9 @@ void position::play_move(const uint32_t move, const bool gives_check) {
     pos_info_->draw50_moves = 0;
   }
 
-  main_hash.prefetch_entry(key);
+  this_thread_->hash_table->prefetch_entry(key);
 
-  piece_bb_[all_pieces] = color_bb_[white] | color_bb_[black];
+  board_state_->piece_bb[all_pieces] = board_state_->color_bb[white] | board_state_->color_bb[black];
   pos_info_->captured_piece = capture_piece;
   pos_info_->moved_piece = piece_on_square(to);
   pos_info_->previous_move = move;
@@ -467,10 +530,12 @@ void position::play_null_move() {
   if (pos_info_->enpassant_square != no_square)
     key ^= zobrist::enpassant[file_of(pos_info_->enpassant_square)];
 
-  main_hash.prefetch_entry(key);
+  this_thread_->hash_table->prefetch_entry(key);
 
   std::memcpy(pos_info_ + 1, pos_info_, offsetof(position_info, key));
   pos_info_++;
+  mp_info_++;
+  pin_info_++;
 
   pos_info_->key = key;
   pos_info_->draw50_moves = (pos_info_ - 1)->draw50_moves + 1;
@@ -489,7 +554,19 @@ void position::play_null_move() {
   calculate_check_pins();
 }
 
-bool position::see_test(const uint32_t move, const int limit) const {
+void position::see_test_all(s_move* moves, const int n, const int limit,
+  const uint32_t skip) const {
+  see_cache cache;
+  cache.valid = 0;
+
+  for (auto* z = moves; z < moves + n; z++)
+    if (z->move != skip && !see_test(z->move, limit, &cache))
+      z->move |= see_failed;
+}
+
+bool position::see_test(const uint32_t move, const int limit,
+  see_cache* cache) const {
+  HOT_SCOPE(hot_see_test);
   if (move_type(move) == castle_move) return 0 >= limit;
 
   const auto* const see_value = see_values();
@@ -509,16 +586,30 @@ bool position::see_test(const uint32_t move, const int limit) const {
   if (value >= 0) return true;
 
   occupied ^= from;
-  auto attackers = attack_to(to, occupied) & occupied;
+  uint64_t attackers;
+  if (cache && move_type(move) != enpassant) {
+    if (!(cache->valid & to)) {
+      cache->attackers[to] = attack_to(to);
+      cache->valid |= to;
+    }
+    attackers = cache->attackers[to];
+    if (empty_attack[pt_bishop][to] & from)
+      attackers |= attack_bishop_bb(to, occupied) & pieces(pt_bishop, pt_queen);
+    else if (empty_attack[pt_rook][to] & from)
+      attackers |= attack_rook_bb(to, occupied) & pieces(pt_rook, pt_queen);
+    attackers &= occupied;
+  }
+  else
+    attackers = attack_to(to, occupied) & occupied;
 
   do {
     auto my_attackers = attackers & pieces(~me);
     if (!my_attackers) return true;
     {
-      auto pinned = my_attackers & pos_info_->x_ray[~me];
+      auto pinned = my_attackers & pin_info_->x_ray[~me];
       while (pinned) {
         if (const auto sq = pop_lsb(&pinned);
-          occupied & pos_info_->pin_by[sq]) {
+          occupied & pin_info_->pin_by[sq]) {
           my_attackers ^= sq;
           if (!my_attackers) return true;
         }
@@ -557,10 +648,10 @@ bool position::see_test(const uint32_t move, const int limit) const {
     my_attackers = attackers & pieces(me);
     if (!my_attackers) return false;
     {
-      auto pinned = my_attackers & pos_info_->x_ray[me];
+      auto pinned = my_attackers & pin_info_->x_ray[me];
       while (pinned) {
         if (const auto sq = pop_lsb(&pinned);
-          occupied & pos_info_->pin_by[sq]) {
+          occupied & pin_info_->pin_by[sq]) {
           my_attackers ^= sq;
           if (!my_attackers) return false;
         }
@@ -658,7 +749,7 @@ void position::set_position_info(position_info* si) const {
 
   for (auto color = white; color <= black; ++color)
     for (auto piece = pt_king; piece <= pt_queen; ++piece)
-      for (auto cnt = 0; cnt < piece_number_[make_piece(color, piece)]; ++cnt)
+      for (auto cnt = 0; cnt < board_state_->piece_number[make_piece(color, piece)]; ++cnt)
         si->material_key ^= zobrist::psq[make_piece(color, piece)][cnt];
 
   calculate_bishop_color_key();
@@ -667,7 +758,7 @@ void position::set_position_info(position_info* si) const {
     for (auto piece = pt_knight; piece <= pt_queen; ++piece)
       si->non_pawn_material[color] +=
       material_value[piece] *
-      static_cast<int>(piece_number_[make_piece(color, piece)]);
+      static_cast<int>(board_state_->piece_number[make_piece(color, piece)]);
 }
 
 position& position::set(const std::string& fen_str, const bool is_chess960,
@@ -680,9 +771,15 @@ position& position::set(const std::string& fen_str, const bool is_chess960,
   std::istringstream ss(fen_str);
 
   std::memset(this, 0, sizeof(position));
-  std::fill_n(&piece_list_[0][0], sizeof piece_list_ / sizeof(square),
-    no_square);
+#ifdef COPY_MAKE
+  board_state_ = th->ti->board_stack;
+  std::memset(board_state_, 0, sizeof(board_state));
+#endif
+  std::fill_n(&board_state_->piece_list[0][0],
+    sizeof board_state_->piece_list / sizeof(square), no_square);
   pos_info_ = th->ti->position_inf + 5;
+  mp_info_ = th->ti->movepick_inf + 5;
+  pin_info_ = th->ti->pin_inf + 5;
   std::memset(pos_info_, 0, sizeof(position_info));
   chess960_ = is_chess960;
 
@@ -701,7 +798,7 @@ position& position::set(const std::string& fen_str, const bool is_chess960,
       ++sq;
     }
   }
-  piece_bb_[all_pieces] = color_bb_[white] | color_bb_[black];
+  board_state_->piece_bb[all_pieces] = board_state_->color_bb[white] | board_state_->color_bb[black];
 
   ss >> token;
   on_move_ = token == 'w' ? white : black;
@@ -758,11 +855,15 @@ position& position::set(const std::string& fen_str, const bool is_chess960,
   return *this;
 }
 
-void position::take_move_back(const uint32_t move) {
+void position::take_move_back([[maybe_unused]] const uint32_t move) {
+  HOT_SCOPE(hot_take_move_back);
   assert(is_ok(move));
 
   on_move_ = ~on_move_;
 
+#ifdef COPY_MAKE
+  --board_state_;
+#else
   const auto me = on_move_;
   const auto from = from_square(move);
   const auto to = to_square(move);
@@ -812,13 +913,18 @@ void position::take_move_back(const uint32_t move) {
       }
     }
   }
-  piece_bb_[all_pieces] = color_bb_[white] | color_bb_[black];
+  board_state_->piece_bb[all_pieces] = board_state_->color_bb[white] | board_state_->color_bb[black];
+#endif
 
   pos_info_--;
+  mp_info_--;
+  pin_info_--;
 }
 
 void position::take_null_back() {
   pos_info_--;
+  mp_info_--;
+  pin_info_--;
   on_move_ = ~on_move_;
 }
 
@@ -867,7 +973,7 @@ bool position::valid_move(const uint32_t move) const {
       if (!((get_between(lsb(is_in_check()), king(me)) | is_in_check()) & to))
         return false;
     }
-    else if (attack_to(to, pieces() ^ from) & pieces(~me))
+    else if (king_danger() & to)
       return false;
   }
 
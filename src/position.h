@@ -65,17 +65,8 @@ namespace pst {
   extern int psq[num_pieces][num_squares];
 }
 
-struct attack_info {
-  uint64_t attack[num_sides][num_piecetypes];
-  uint64_t double_attack[num_sides];
-  uint64_t pinned[num_sides];
-  uint64_t mobility_mask[num_sides];
-  int k_attack_score[num_sides];
-  bool strong_threat[num_sides];
-  uint64_t k_zone[num_sides];
-};
-
-struct position_info {
+// one ply is exactly three cache lines, aligned so it never spans four
+struct alignas(64) position_info {
   uint64_t pawn_key;
   uint64_t material_key, bishop_color_key;
   int non_pawn_material[num_sides];
@@ -92,7 +83,6 @@ struct position_info {
   bool eval_is_exact;
   counter_move_values* move_counter_values;
   uint64_t in_check;
-  uint64_t x_ray[num_sides];
   uint64_t check_squares[num_piecetypes];
   uint32_t* pv;
   uint32_t killers[2];
@@ -101,21 +91,51 @@ struct position_info {
   int eval_positional;
   uint8_t eval_factor, lmr_reduction;
   bool no_early_pruning, move_repetition;
+};
 
+struct alignas(64) movepick_info {
   s_move* mp_current_move, * mp_end_list, * mp_end_bad_capture;
   stage mp_stage;
   uint32_t mp_hash_move, mp_counter_move;
   int mp_depth;
   square mp_capture_square;
-  bool mp_only_quiet_check_moves, dummy_y[2];
+  bool mp_only_quiet_check_moves;
+  uint8_t mp_see_picks, dummy_y;
   int mp_threshold;
   uint8_t mp_delayed_number, mp_delayed_current;
   uint16_t mp_delayed[delayed_number];
+};
 
+struct attack_info {
+  uint64_t king_danger;
+  bool valid;
+};
+
+struct pin_info {
+  uint64_t x_ray[num_sides];
+  attack_info attacks;
   square pin_by[num_squares];
 };
 
+struct see_cache {
+  uint64_t attackers[num_squares];
+  uint64_t valid;
+};
+
+// the board representation make and unmake change piece by piece. copy-make
+// builds keep one per played move on the thread's board_stack
+struct board_state {
+  ptype board[num_squares];
+  uint64_t piece_bb[num_pieces];
+  uint64_t color_bb[num_sides];
+  uint8_t piece_number[num_pieces];
+  square piece_list[num_pieces][16];
+  uint8_t piece_index[num_squares];
+};
+
 static_assert(offsetof(position_info, key) == 48, "offset wrong");
+static_assert(sizeof(position_info) == 3 * 64, "position_info size wrong");
+static_assert(sizeof(movepick_info) == 64, "movepick_info size wrong");
 
 class position {
 public:
@@ -156,6 +176,7 @@ public:
   [[nodiscard]] uint64_t is_in_check() const;
   [[nodiscard]] uint64_t discovered_check_possible() const;
   [[nodiscard]] uint64_t pinned_pieces() const;
+  [[nodiscard]] uint64_t king_danger() const;
   void calculate_check_pins() const;
   template <side color>
   void calculate_pins() const;
@@ -189,7 +210,10 @@ public:
   void take_null_back();
 
   [[nodiscard]] static const int* see_values();
-  [[nodiscard]] bool see_test(uint32_t move, int limit) const;
+  [[nodiscard]] bool see_test(uint32_t move, int limit) const {
+    return see_test(move, limit, nullptr);
+  }
+  void see_test_all(s_move* moves, int n, int limit, uint32_t skip) const;
 
   [[nodiscard]] uint64_t key() const;
   [[nodiscard]] uint64_t key_after_move(uint32_t move) const;
@@ -203,6 +227,7 @@ public:
   [[nodiscard]] int game_phase() const;
   [[nodiscard]] int game_ply() const;
   void increase_game_ply();
+  void trim_history();
   [[nodiscard]] bool is_chess960() const;
   [[nodiscard]] thread* my_thread() const;
   [[nodiscard]] threadinfo* thread_info() const;
@@ -216,6 +241,14 @@ public:
     return pos_info_;
   }
 
+  [[nodiscard]] movepick_info* mp_info() const {
+    return mp_info_;
+  }
+
+  [[nodiscard]] pin_info* pins() const {
+    return pin_info_;
+  }
+
   void copy_position(const position* pos, thread* th,
     const position_info* copy_state);
   double epd_result;
@@ -223,6 +256,7 @@ private:
   void set_castling_possibilities(side color, square from_r);
   void set_position_info(position_info* si) const;
   void calculate_bishop_color_key() const;
+  void calculate_king_danger() const;
 
   void move_piece(side color, ptype piece, square sq);
   void delete_piece(side color, ptype piece, square sq);
@@ -231,55 +265,60 @@ private:
   void do_castle_move(side me, square from, square to, square& from_r,
     square& to_r);
   [[nodiscard]] bool is_draw() const;
+  [[nodiscard]] bool see_test(uint32_t move, int limit, see_cache* cache) const;
 
   position_info* pos_info_;
+  movepick_info* mp_info_;
+  pin_info* pin_info_;
   side on_move_;
   thread* this_thread_;
   threadinfo* thread_info_;
   cmhinfo* cmh_info_;
-  ptype board_[num_squares];
-  uint64_t piece_bb_[num_pieces];
-  uint64_t color_bb_[num_sides];
-  uint8_t piece_number_[num_pieces];
-  square piece_list_[num_pieces][16];
-  uint8_t piece_index_[num_squares];
+#ifdef COPY_MAKE
+  // play_move copies the board forward into the next entry of board_stack
+  // and changes the copy, take_move_back only steps back
+  board_state* board_state_;
+#else
+  // an array of one so board_state_-> reads the same in both builds
+  board_state board_state_[1];
+#endif
   uint8_t castle_mask_[num_squares];
   square castle_rook_square_[num_squares];
   uint64_t castle_path_[castle_possible_n];
   uint64_t nodes_;
   int game_ply_;
   bool chess960_;
-  char filler_[32];
+  char filler_[16];
 };
 
 inline void position::move_piece(const side color, const ptype piece,
   const square sq) {
-  board_[sq] = piece;
-  piece_bb_[piece] |= sq;
-  color_bb_[color] |= sq;
-  piece_index_[sq] = piece_number_[piece]++;
-  piece_list_[piece][piece_index_[sq]] = sq;
+  board_state_->board[sq] = piece;
+  board_state_->piece_bb[piece] |= sq;
+  board_state_->color_bb[color] |= sq;
+  board_state_->piece_index[sq] = board_state_->piece_number[piece]++;
+  board_state_->piece_list[piece][board_state_->piece_index[sq]] = sq;
 }
 
 inline void position::delete_piece(const side color, const ptype piece,
   const square sq) {
-  piece_bb_[piece] ^= sq;
-  color_bb_[color] ^= sq;
-  const auto last_square = piece_list_[piece][--piece_number_[piece]];
-  piece_index_[last_square] = piece_index_[sq];
-  piece_list_[piece][piece_index_[last_square]] = last_square;
-  piece_list_[piece][piece_number_[piece]] = no_square;
+  board_state_->piece_bb[piece] ^= sq;
+  board_state_->color_bb[color] ^= sq;
+  const auto last_square = board_state_->piece_list[piece][--board_state_->piece_number[piece]];
+  board_state_->piece_index[last_square] = board_state_->piece_index[sq];
+  board_state_->piece_list[piece][board_state_->piece_index[last_square]] = last_square;
+  board_state_->piece_list[piece][board_state_->piece_number[piece]] = no_square;
 }
 
 inline void position::relocate_piece(const side color, const ptype piece,
   const square from, const square to) {
   const auto van_to_bb = square_bb[from] ^ square_bb[to];
-  piece_bb_[piece] ^= van_to_bb;
-  color_bb_[color] ^= van_to_bb;
-  board_[from] = no_piece;
-  board_[to] = piece;
-  piece_index_[to] = piece_index_[from];
-  piece_list_[piece][piece_index_[to]] = to;
+  board_state_->piece_bb[piece] ^= van_to_bb;
+  board_state_->color_bb[color] ^= van_to_bb;
+  board_state_->board[from] = no_piece;
+  board_state_->board[to] = piece;
+  board_state_->piece_index[to] = board_state_->piece_index[from];
+  board_state_->piece_list[piece][board_state_->piece_index[to]] = to;
 }
 
 inline bool position::advanced_pawn(const uint32_t move) const {
@@ -346,17 +385,17 @@ inline cmhinfo* position::cmh_info() const {
 }
 
 inline bool position::different_color_bishops() const {
-  return piece_number_[w_bishop] == 1 && piece_number_[b_bishop] == 1 &&
+  return board_state_->piece_number[w_bishop] == 1 && board_state_->piece_number[b_bishop] == 1 &&
     different_color(piece_square(white, pt_bishop),
     piece_square(black, pt_bishop));
 }
 
 inline uint64_t position::discovered_check_possible() const {
-  return pos_info_->x_ray[~on_move_] & pieces(on_move_);
+  return pin_info_->x_ray[~on_move_] & pieces(on_move_);
 }
 
 inline bool position::empty_square(const square sq) const {
-  return board_[sq] == no_piece;
+  return board_state_->board[sq] == no_piece;
 }
 
 inline square position::enpassant_square() const {
@@ -398,7 +437,7 @@ inline uint64_t position::key() const {
 }
 
 inline square position::king(const side color) const {
-  return piece_list_[make_piece(color, pt_king)][0];
+  return board_state_->piece_list[make_piece(color, pt_king)][0];
 }
 
 inline uint64_t position::material_key() const {
@@ -412,7 +451,7 @@ inline bool position::material_or_castle_changed() const {
 }
 
 inline ptype position::moved_piece(const uint32_t move) const {
-  return board_[from_square(move)];
+  return board_state_->board[from_square(move)];
 }
 
 inline thread* position::my_thread() const {
@@ -424,11 +463,11 @@ inline int position::non_pawn_material(const side color) const {
 }
 
 inline int position::number(const side color, const uint8_t piece) const {
-  return piece_number_[make_piece(color, piece)];
+  return board_state_->piece_number[make_piece(color, piece)];
 }
 
 inline int position::number(const ptype piece) const {
-  return piece_number_[piece];
+  return board_state_->piece_number[piece];
 }
 
 inline side position::on_move() const {
@@ -449,31 +488,31 @@ inline uint64_t position::pawn_key() const {
 
 inline const square* position::piece_list(const side color,
   const uint8_t piece) const {
-  return piece_list_[make_piece(color, piece)];
+  return board_state_->piece_list[make_piece(color, piece)];
 }
 
 inline ptype position::piece_on_square(const square sq) const {
-  return board_[sq];
+  return board_state_->board[sq];
 }
 
 inline square position::piece_square(const side color,
   const uint8_t piece) const {
-  assert(piece_number_[make_piece(color, piece)] == 1);
-  return piece_list_[make_piece(color, piece)][0];
+  assert(board_state_->piece_number[make_piece(color, piece)] == 1);
+  return board_state_->piece_list[make_piece(color, piece)][0];
 }
 
 inline uint64_t position::pieces_excluded(const side color,
   const uint8_t piece) const {
-  return color_bb_[color] ^ piece_bb_[make_piece(color, piece)];
+  return board_state_->color_bb[color] ^ board_state_->piece_bb[make_piece(color, piece)];
 }
 
 inline uint64_t position::pieces() const {
-  return piece_bb_[all_pieces];
+  return board_state_->piece_bb[all_pieces];
 }
 
 inline uint64_t position::pieces(const uint8_t piece) const {
-  return piece_bb_[make_piece(white, piece)] |
-    piece_bb_[make_piece(black, piece)];
+  return board_state_->piece_bb[make_piece(white, piece)] |
+    board_state_->piece_bb[make_piece(black, piece)];
 }
 
 inline uint64_t position::pieces(const uint8_t piece1,
@@ -482,11 +521,11 @@ inline uint64_t position::pieces(const uint8_t piece1,
 }
 
 inline uint64_t position::pieces(const side color) const {
-  return color_bb_[color];
+  return board_state_->color_bb[color];
 }
 
 inline uint64_t position::pieces(const side color, const uint8_t piece) const {
-  return piece_bb_[make_piece(color, piece)];
+  return board_state_->piece_bb[make_piece(color, piece)];
 }
 
 inline uint64_t position::pieces(const side color, const uint8_t piece1,
@@ -501,7 +540,12 @@ inline uint64_t position::pieces(const side color, const uint8_t piece1,
 }
 
 inline uint64_t position::pinned_pieces() const {
-  return pos_info_->x_ray[on_move_] & pieces(on_move_);
+  return pin_info_->x_ray[on_move_] & pieces(on_move_);
+}
+
+inline uint64_t position::king_danger() const {
+  if (!pin_info_->attacks.valid) calculate_king_danger();
+  return pin_info_->attacks.king_danger;
 }
 
 inline int position::psq_score() const {
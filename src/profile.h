@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include "main.h"
+
+// scoped rdtsc timers around the hot paths of a node, enabled with
+// make hotprofile=yes. time is exclusive: a nested scope (see_test inside
+// pick_move) is charged to itself only, not to its parent.
+
+enum hot_section : uint8_t {
+  hot_eval,
+  hot_pick_move,
+  hot_hash_probe,
+  hot_hash_replace,
+  hot_play_move,
+  hot_take_move_back,
+  hot_see_test,
+  hot_generate_moves,
+  num_hot_sections
+};
+
+struct hot_profile {
+  uint64_t cycles[num_hot_sections];
+  uint64_t calls[num_hot_sections];
+  uint64_t search_cycles;
+  uint64_t child;
+};
+
+#ifdef HOT_PROFILE
+// one per OS thread, written only by its owner: no atomics needed. search
+// threads publish its address in threadinfo for the report.
+inline thread_local hot_profile thread_hot_profile{};
+
+class hot_scope {
+  const hot_section section_;
+  const uint64_t saved_child_;
+  const uint64_t start_;
+public:
+  explicit hot_scope(const hot_section section)
+    : section_(section), saved_child_(thread_hot_profile.child),
+    start_(__rdtsc()) {
+    thread_hot_profile.child = 0;
+  }
+
+  ~hot_scope() {
+    auto& p = thread_hot_profile;
+    const auto elapsed = __rdtsc() - start_;
+    p.cycles[section_] += elapsed - p.child;
+    ++p.calls[section_];
+    p.child = saved_child_ + elapsed;
+  }
+
+  hot_scope(const hot_scope&) = delete;
+  hot_scope& operator=(const hot_scope&) = delete;
+};
+
+#define HOT_SCOPE_NAME(line) hot_scope_##line
+#define HOT_SCOPE_LINE(section, line) const hot_scope HOT_SCOPE_NAME(line)(section)
+#define HOT_SCOPE(section) HOT_SCOPE_LINE(section, __LINE__)
+#else
+#define HOT_SCOPE(section)
+#endif
@@ -1,4 +1,6 @@
 #include "search.h"
+#include <cmath>
+#include <iomanip>
 #include <sstream>
 #include "chrono.h"
 #include "evaluate.h"
@@ -16,6 +18,50 @@ namespace search {
     if (param.use_time_calculating()) time_control.adjustment_after_ponder_hit();
   }
 
+  int64_t hard_deadline() {
+    if (param.ponder) return 0;
+    if (param.move_time) return param.move_time;
+    if (param.use_time_calculating())
+      return std::max(time_control.maximum() - 9, static_cast<int64_t>(1));
+    return 0;
+  }
+
+#ifdef SEARCH_STATS
+  static cut_source cut_source_of(const stage st) {
+    switch (st) {
+    case gen_good_captures:
+    case gen_check_evasions:
+      return cut_hash_move;
+    case good_captures:
+      return cut_good_captures;
+    case killers_1:
+      return cut_killers_1;
+    case killers_2:
+      return cut_killers_2;
+    case gen_bxp_captures:
+      return cut_counter_move;
+    case bxp_captures:
+      return cut_bxp_captures;
+    case quietmoves:
+      return cut_quietmoves;
+    case bad_captures:
+      return cut_bad_captures;
+    case delayed_moves:
+      return cut_delayed_moves;
+    default:
+      return cut_check_evasions;
+    }
+  }
+
+  static void record_cutoff(const position& pos, const int move_number) {
+    auto& stats = pos.thread_info()->stats;
+    const auto source = cut_source_of(pos.mp_info()->mp_stage);
+    ++stats.cutoffs[source];
+    stats.move_index[source] += move_number;
+    if (move_number == 1) ++stats.first_move_cutoffs;
+  }
+#endif
+
   template <nodetype nt>
   int alpha_beta(position& pos, int alpha, int beta, int depth, bool cut_node) {
     constexpr auto null_move_tempo_mult = 2;
@@ -64,32 +110,35 @@ namespace search {
     auto quiet_move_number = 0;
 
     auto* pi = pos.info();
+    auto* mp = pos.mp_info();
     const auto root_node = pv_node && pi->ply == 1;
 
     auto* my_thread = pos.my_thread();
+    auto* main_thread =
+      my_thread == thread_pool.main() ? thread_pool.main() : nullptr;
+    auto& hash_table = *my_thread->hash_table;
     state_check = pi->in_check;
     move_number = 0;
     quiet_move_number = 0;
     pi->move_number = 0;
 
-    if (my_thread == thread_pool.main()) {
-      if (auto* main_thread = dynamic_cast<mainthread*>(my_thread);
-        ++main_thread->interrupt_counter >= 4096) {
-        if (main_thread->quick_move_evaluation_busy) {
-          if (main_thread->quick_move_evaluation_stopped) return alpha;
-          if (auto elapsed = time_control.elapsed();
-            elapsed > 1000 || elapsed > time_control.optimum() / 16) {
-            main_thread->quick_move_evaluation_stopped = true;
-            return alpha;
-          }
+    if (main_thread &&
+      ++main_thread->interrupt_counter >= main_thread->poll_interval) {
+      if (main_thread->quick_move_evaluation_busy) {
+        if (main_thread->quick_move_evaluation_stopped) return alpha;
+        if (auto elapsed = time_control.elapsed();
+          elapsed > 1000 || elapsed > time_control.optimum() / 16) {
+          main_thread->quick_move_evaluation_stopped = true;
+          return alpha;
         }
-        send_time_info();
-        main_thread->interrupt_counter = 0;
       }
+      send_time_info();
+      main_thread->adjust_poll_interval();
+      main_thread->interrupt_counter = 0;
     }
 
     if (!root_node) {
-      if (signals.stop_analyzing.load(std::memory_order_relaxed) ||
+      if (my_thread->signals->stop_analyzing.load(std::memory_order_relaxed) ||
         pi->move_repetition || pi->ply >= max_ply)
         return pi->ply >= max_ply && !state_check
         ? evaluate::eval(pos)
@@ -115,7 +164,7 @@ namespace search {
 
     key64 = pi->key;
     key64 ^= pos.draw50_key();
-    hash_entry = main_hash.probe(key64);
+    hash_entry = hash_table.probe(key64);
     hash_value =
       hash_entry ? value_from_hash(hash_entry->value(), pi->ply) : no_score;
     hash_move = root_node
@@ -161,9 +210,9 @@ namespace search {
       pi->position_value = eval;
       if (pi->eval_is_exact && !root_node) return eval;
 
-      hash_entry = main_hash.replace(key64);
+      hash_entry = hash_table.replace(key64);
       hash_entry->save(key64, no_score, no_limit + pi->strong_threat, no_depth,
-        no_move, pi->position_value, main_hash.age());
+        no_move, pi->position_value, hash_table.age());
     }
 
     if (pi->previous_move != null_move && (pi - 1)->position_value != no_score &&
@@ -228,7 +277,7 @@ namespace search {
         static_cast<int>((hash_move != no_move)),
         3 * 256), 0)) / 256 * plies;
 
-      pi->mp_end_list = (pi - 1)->mp_end_list;
+      mp->mp_end_list = (mp - 1)->mp_end_list;
       pos.play_null_move();
       (pi + 1)->no_early_pruning = true;
       auto value =
@@ -269,7 +318,7 @@ namespace search {
       thread_pool.dummy_null_move_threat &&
       depth >= dummy_null_move_threat_min_depth_mult * plies &&
       eval >= beta && (pi - 1)->lmr_reduction) {
-      pi->mp_end_list = (pi - 1)->mp_end_list;
+      mp->mp_end_list = (mp - 1)->mp_end_list;
       pos.play_null_move();
       (pi + 1)->no_early_pruning = true;
       auto null_beta = beta - 240;
@@ -333,7 +382,7 @@ namespace search {
       alpha_beta<nt>(pos, alpha, beta, d, !pv_node && cut_node);
       pi->no_early_pruning = false;
 
-      hash_entry = main_hash.probe(key64);
+      hash_entry = hash_table.probe(key64);
       hash_move = hash_entry ? hash_entry->move() : no_move;
     }
 
@@ -370,7 +419,7 @@ namespace search {
 
       pi->move_number = ++move_number;
 
-      if (!bench_active && root_node && my_thread == thread_pool.main()) {
+      if (!bench_active && root_node && main_thread) {
         if (constexpr auto info_currmove_interval = 4000;
           time_control.elapsed() > info_currmove_interval)
           acout() << "info currmove " << move_to_string(move, pos)
@@ -391,8 +440,8 @@ namespace search {
       extension = depth_0;
 
       if (gives_check &&
-        (pi->mp_stage == good_captures || move_number < late_move_count) &&
-        (pi->mp_stage == good_captures || pos.see_test(move, see_0)))
+        (mp->mp_stage == good_captures || move_number < late_move_count) &&
+        (mp->mp_stage == good_captures || pos.see_test(move, see_0)))
         extension = plies;
 
       if (constexpr auto excluded_move_min_depth = 8;
@@ -405,7 +454,7 @@ namespace search {
         pos.legal_move(move)) {
         constexpr auto excluded_move_r_beta_hash_value_margin_div = 5;
         constexpr auto excluded_move_r_beta_hash_value_margin_mult = 8;
-        auto cm = pi->mp_counter_move;
+        auto cm = mp->mp_counter_move;
         auto r_beta =
           hash_value - depth / plies *
           excluded_move_r_beta_hash_value_margin_mult /
@@ -421,8 +470,8 @@ namespace search {
         pi->excluded_move = no_move;
 
         movepick::init_search(pos, hash_move, depth, false);
-        pi->mp_counter_move = cm;
-        ++pi->mp_stage;
+        mp->mp_counter_move = cm;
+        ++mp->mp_stage;
         pi->move_number = move_number;
       }
 
@@ -435,7 +484,7 @@ namespace search {
         if (move_number >= late_move_count) continue;
 
         if (constexpr auto quiet_moves_max_depth = 6;
-          depth < quiet_moves_max_depth * plies && pi->mp_stage >= quietmoves) {
+          depth < quiet_moves_max_depth * plies && mp->mp_stage >= quietmoves) {
           auto offset =
             counter_move_values::calculate_offset(moved_piece, to_square(move));
 
@@ -476,7 +525,7 @@ namespace search {
         best_score > -longest_mate_score) {
         constexpr auto non_root_node_see_test_mult = 20;
         if (constexpr auto non_root_node_see_test_base = 150;
-          pi->mp_stage != good_captures && extension != plies &&
+          mp->mp_stage != good_captures && extension != plies &&
           !pos.see_test(move, std::min(see_knight - see_bishop,
           non_root_node_see_test_base -
           non_root_node_see_test_mult * depth *
@@ -579,10 +628,10 @@ namespace search {
 
       assert(value > -max_score && value < max_score);
 
-      if (signals.stop_analyzing.load(std::memory_order_relaxed)) return alpha;
+      if (my_thread->signals->stop_analyzing.load(std::memory_order_relaxed))
+        return alpha;
 
-      if (my_thread == thread_pool.main() &&
-        dynamic_cast<mainthread*>(my_thread)->quick_move_evaluation_stopped)
+      if (main_thread && main_thread->quick_move_evaluation_stopped)
         return alpha;
 
       if (root_node) {
@@ -598,10 +647,10 @@ namespace search {
 
           for (auto* z = (pi + 1)->pv; *z != no_move; ++z) root_move.pv.add(*z);
 
-          if (move_number > 1 && my_thread == thread_pool.main())
-            dynamic_cast<mainthread*>(my_thread)->best_move_changed += 1024;
+          if (move_number > 1 && main_thread)
+            main_thread->best_move_changed += 1024;
 
-          if (!bench_active && my_thread == thread_pool.main())
+          if (!bench_active && main_thread)
             acout() << print_pv(pos, alpha, beta, my_thread->active_pv,
             move_index)
             << std::endl;
@@ -614,7 +663,7 @@ namespace search {
         best_score = value;
 
         if (value > alpha) {
-          if (pv_node && my_thread == thread_pool.main() &&
+          if (pv_node && main_thread &&
             easy_move.expected_move(pi->key) &&
             (move != easy_move.expected_move(pi->key) || move_number > 1))
             easy_move.clear();
@@ -627,6 +676,9 @@ namespace search {
             alpha = value;
           else {
             assert(value >= beta);
+#ifdef SEARCH_STATS
+            record_cutoff(pos, move_number);
+#endif
             break;
           }
         }
@@ -681,7 +733,7 @@ namespace search {
     }
 
     if (!pi->excluded_move) {
-      hash_entry = main_hash.replace(key64);
+      hash_entry = hash_table.replace(key64);
       hash_entry->save(key64, value_to_hash(best_score, pi->ply),
         (best_score >= beta
         ? south_border
@@ -689,7 +741,7 @@ namespace search {
         ? exact_value
         : north_border) +
         pi->strong_threat,
-        depth, best_move, pi->position_value, main_hash.age());
+        depth, best_move, pi->position_value, hash_table.age());
     }
 
     return best_score;
@@ -760,6 +812,7 @@ namespace search {
     int orig_alpha = {};
 
     auto* pi = pos.info();
+    auto& hash_table = *pos.my_thread()->hash_table;
 
     if (pv_node) {
       uint32_t pv[max_ply + 1];
@@ -781,7 +834,7 @@ namespace search {
 
     auto key64 = pi->key;
     key64 ^= pos.draw50_key();
-    auto* hash_entry = main_hash.probe(key64);
+    auto* hash_entry = hash_table.probe(key64);
     const auto hash_move = hash_entry ? hash_entry->move() : no_move;
     const auto hash_value =
       hash_entry ? value_from_hash(hash_entry->value(), pi->ply) : no_score;
@@ -819,10 +872,10 @@ namespace search {
         if (pi->eval_is_exact) return best_value;
 
         if (best_value >= beta) {
-          hash_entry = main_hash.replace(key64);
+          hash_entry = hash_table.replace(key64);
           hash_entry->save(key64, value_to_hash(best_value, pi->ply),
             south_border + pi->strong_threat, no_depth, no_move,
-            pi->position_value, main_hash.age());
+            pi->position_value, hash_table.age());
           return best_value;
         }
       }
@@ -951,10 +1004,10 @@ namespace search {
             best_move = move;
           }
           else {
-            hash_entry = main_hash.replace(key64);
+            hash_entry = hash_table.replace(key64);
             hash_entry->save(key64, value_to_hash(value, pi->ply),
               south_border + pi->strong_threat, hash_depth, move,
-              pi->position_value, main_hash.age());
+              pi->position_value, hash_table.age());
 
             return value;
           }
@@ -964,12 +1017,12 @@ namespace search {
 
     if (state_check && best_value == -max_score) return gets_mated(pi->ply);
 
-    hash_entry = main_hash.replace(key64);
+    hash_entry = hash_table.replace(key64);
     hash_entry->save(
       key64, value_to_hash(best_value, pi->ply),
       (pv_node && best_value > orig_alpha ? exact_value : north_border) +
       pi->strong_threat,
-      hash_depth, best_move, pi->position_value, main_hash.age());
+      hash_depth, best_move, pi->position_value, hash_table.age());
 
     assert(best_value > -max_score && best_value < max_score);
 
@@ -995,6 +1048,112 @@ namespace search {
     thread_pool.main()->quick_move_allow = false;
   }
 
+  void reset_stats() {
+#ifdef SEARCH_STATS
+    for (auto i = 0; i < thread_pool.thread_count; ++i)
+      thread_pool.threads[i]->ti->stats = {};
+#endif
+  }
+
+  void reset_profile() {
+#ifdef HOT_PROFILE
+    for (auto i = 0; i < thread_pool.thread_count; ++i)
+      *thread_pool.threads[i]->ti->profile = {};
+#endif
+  }
+
+  void print_profile() {
+#ifdef HOT_PROFILE
+    constexpr const char* section_names[num_hot_sections] = {
+      "eval", "pick_move", "hash probe", "hash replace", "play_move",
+      "take_move_back", "see_test", "generate_moves"
+    };
+
+    hot_profile total{};
+    for (auto i = 0; i < thread_pool.thread_count; ++i) {
+      const auto* prof = thread_pool.threads[i]->ti->profile;
+      for (auto n = 0; n < num_hot_sections; ++n) {
+        total.cycles[n] += prof->cycles[n];
+        total.calls[n] += prof->calls[n];
+      }
+      total.search_cycles += prof->search_cycles;
+    }
+
+    uint64_t sections = 0;
+    for (const auto c : total.cycles) sections += c;
+    const auto percent = [&total](const uint64_t n) {
+      return total.search_cycles
+        ? 100.0 * static_cast<double>(n) / total.search_cycles
+        : 0.0;
+    };
+
+    std::ostringstream ss;
+    ss.precision(1);
+    ss << std::fixed;
+    for (auto n = 0; n < num_hot_sections; ++n)
+      ss << std::left << std::setw(16) << section_names[n] << std::right
+      << std::setw(7) << percent(total.cycles[n]) << "% " << std::setw(12)
+      << total.calls[n] << " calls " << std::setw(8)
+      << (total.calls[n]
+        ? static_cast<double>(total.cycles[n]) / total.calls[n]
+        : 0.0)
+      << " cycles/call" << std::endl;
+    ss << std::left << std::setw(16) << "search (rest)" << std::right
+      << std::setw(7)
+      << percent(total.search_cycles > sections
+        ? total.search_cycles - sections
+        : 0)
+      << '%' << std::endl;
+    acout() << ss.str();
+#endif
+  }
+
+  void print_stats() {
+#ifdef SEARCH_STATS
+    constexpr const char* source_names[num_cut_sources] = {
+      "hash move", "good captures", "killers 1", "killers 2", "counter move",
+      "bxp captures", "quiet moves", "bad captures", "delayed moves",
+      "check evasions"
+    };
+
+    search_stats total{};
+    for (auto i = 0; i < thread_pool.thread_count; ++i) {
+      const auto& stats = thread_pool.threads[i]->ti->stats;
+      for (auto n = 0; n < num_cut_sources; ++n) {
+        total.cutoffs[n] += stats.cutoffs[n];
+        total.move_index[n] += stats.move_index[n];
+      }
+      total.first_move_cutoffs += stats.first_move_cutoffs;
+    }
+
+    uint64_t cutoffs = 0;
+    for (const auto n : total.cutoffs) cutoffs += n;
+    const auto percent = [cutoffs](const uint64_t n) {
+      return cutoffs ? 100.0 * static_cast<double>(n) / cutoffs : 0.0;
+    };
+
+    std::ostringstream ss;
+    ss.precision(1);
+    ss << std::fixed << "cutoffs " << cutoffs << " first move "
+      << percent(total.first_move_cutoffs) << '%' << std::endl;
+    for (auto n = 0; n < num_cut_sources; ++n) {
+      ss.precision(1);
+      ss << std::left << std::setw(16) << source_names[n] << std::right
+        << std::setw(12) << total.cutoffs[n] << std::setw(7)
+        << percent(total.cutoffs[n]) << "% avg index ";
+      ss.precision(2);
+      ss << (total.cutoffs[n]
+        ? static_cast<double>(total.move_index[n]) / total.cutoffs[n]
+        : 0.0)
+        << std::endl;
+    }
+    acout() << ss.str();
+#else
+    acout() << "info string searchstats requires a build with searchstats=yes"
+      << std::endl;
+#endif
+  }
+
   void send_time_info() {
     const auto elapsed = time_control.elapsed();
 
@@ -1008,8 +1167,8 @@ namespace search {
 
     if (param.ponder) return;
 
-    if (param.use_time_calculating() && elapsed > time_control.maximum() - 10 ||
-      param.move_time && elapsed >= param.move_time ||
+    if (const auto deadline = hard_deadline();
+      deadline && elapsed >= deadline ||
       param.nodes && thread_pool.visited_nodes() >= param.nodes)
       signals.stop_analyzing = true;
   }
@@ -1164,8 +1323,10 @@ void mainthread::begin_search() {
   root_position->copy_position(thread_pool.root_position, nullptr, nullptr);
   const auto me = root_position->on_move();
   time_control.init(search::param, me, root_position->game_ply());
+  thread_pool.timer->arm(true);
   search::previous_info_time = 0;
   interrupt_counter = 0;
+  last_poll_time = now();
   thread_pool.contempt_color = me;
   thread_pool.analysis_mode = !search::param.use_time_calculating();
 
@@ -1259,11 +1420,15 @@ void mainthread::begin_search() {
     if (root_moves[0].depth == main_thread_inc)
       root_moves[0].depth = 99 * main_thread_inc;
 
+    // a ponderhit that clears the flag after the test above sees
+    // stop_if_ponder_hit and stops, so the flag is read again after it
     search::signals.stop_if_ponder_hit = true;
-    wait(search::signals.stop_analyzing);
+    if (search::param.ponder || search::param.infinite)
+      wait(search::signals.stop_analyzing);
   }
 
   search::signals.stop_analyzing = true;
+  thread_pool.timer->arm(false);
 
   for (auto i = 1; i < thread_pool.active_thread_count; ++i)
     thread_pool.threads[i]->wait_for_search_to_end();
@@ -1298,23 +1463,14 @@ void mainthread::begin_search() {
       *root_position);
     acout() << std::endl;
   }
+  if (const auto request = thread_pool.stop_request_time.exchange(0))
+    thread_pool.stop_latency.add(now_micros() - request);
   thread_pool.total_analyze_time += static_cast<int>(time_control.elapsed());
 
   search::running = false;
 }
 
-void thread::begin_search() {
-  int alpha;
-  int delta_alpha;
-  int delta_beta;
-  auto fast_move = no_move;
-  auto* main_thread = this == thread_pool.main() ? thread_pool.main() : nullptr;
-  if (!main_thread) {
-    root_position->copy_position(thread_pool.root_position, this,
-      thread_pool.root_position_info);
-    root_moves = thread_pool.root_moves;
-  }
-
+void thread::init_search_stack() const {
   auto* pi = root_position->info();
 
   std::memset(pi + 1, 0, 2 * sizeof(position_info));
@@ -1327,13 +1483,30 @@ void thread::begin_search() {
   (pi - 4)->move_counter_values = (pi - 3)->move_counter_values =
     (pi - 2)->move_counter_values = (pi - 1)->move_counter_values =
     pi->move_counter_values = nullptr;
-  (pi - 1)->mp_end_list = root_position->thread_info()->move_list;
+  (root_position->mp_info() - 1)->mp_end_list =
+    root_position->thread_info()->move_list;
   for (auto n = 0; n <= max_ply; n++) {
     (pi + n)->no_early_pruning = false;
     (pi + n)->excluded_move = no_move;
     (pi + n)->lmr_reduction = 0;
     (pi + n)->ply = n + 1;
   }
+}
+
+void thread::begin_search() {
+  int alpha;
+  int delta_alpha;
+  int delta_beta;
+  auto fast_move = no_move;
+  auto* main_thread = this == thread_pool.main() ? thread_pool.main() : nullptr;
+  if (!main_thread) {
+    root_position->copy_position(thread_pool.root_position, this,
+      thread_pool.root_position_info);
+    root_moves = thread_pool.root_moves;
+  }
+
+  init_search_stack();
+  auto* pi = root_position->info();
 
   auto best_value = delta_alpha = delta_beta = alpha = -max_score;
   auto beta = max_score;
@@ -9,6 +9,28 @@ struct search_signals {
   std::atomic_bool stop_analyzing, stop_if_ponder_hit;
 };
 
+#ifdef SEARCH_STATS
+enum cut_source : uint8_t {
+  cut_hash_move,
+  cut_good_captures,
+  cut_killers_1,
+  cut_killers_2,
+  cut_counter_move,
+  cut_bxp_captures,
+  cut_quietmoves,
+  cut_bad_captures,
+  cut_delayed_moves,
+  cut_check_evasions,
+  num_cut_sources
+};
+
+struct search_stats {
+  uint64_t cutoffs[num_cut_sources];
+  uint64_t move_index[num_cut_sources];
+  uint64_t first_move_cutoffs;
+};
+#endif
+
 namespace search {
   inline search_signals signals;
   inline search_param param;
@@ -17,6 +39,7 @@ namespace search {
   void init();
   void reset();
   void adjust_time_after_ponder_hit();
+  int64_t hard_deadline();
 
   enum nodetype : uint8_t { PV, nonPV };
 
@@ -84,6 +107,10 @@ namespace search {
   void update_stats_minus(const position& pos, bool state_check, uint32_t move,
     int depth);
   void send_time_info();
+  void reset_stats();
+  void print_stats();
+  void reset_profile();
+  void print_profile();
 
   inline uint8_t lm_reductions[2][2][64 * static_cast<int>(plies)][64];
 
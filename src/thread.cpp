@@ -1,6 +1,12 @@
 #include "thread.h"
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
+#include <new>
+#include <sstream>
 #include "main.h"
+#include "nnue.h"
+#include "util.h"
 
 static cmhinfo* cmh_data;
 
@@ -27,6 +33,7 @@ thread::~thread() {
 void threadpool::init() {
   cmh_data = static_cast<cmhinfo*>(calloc(sizeof(cmhinfo), true));
 
+  timer = new timerthread;
   threads[0] = new mainthread;
   thread_count = 1;
   change_thread_count(thread_count);
@@ -37,11 +44,15 @@ void threadpool::init() {
 
 void threadpool::begin_search(position& pos, const search_param& time) {
   main()->wait_for_search_to_end();
+  nnue_publish();
 
   search::signals.stop_if_ponder_hit = search::signals.stop_analyzing = false;
+  stop_request_time = 0;
   search::param = time;
 
   root_position = &pos;
+  // drop a ponderhit that came in between searches
+  timer->arm(false);
 
   main()->wake(true);
 }
@@ -60,6 +71,7 @@ void threadpool::change_thread_count(const int num_threads) {
 
 void threadpool::exit() {
   while (thread_count > 0) delete threads[--thread_count];
+  delete timer;
 
   free(cmh_data);
 }
@@ -67,13 +79,15 @@ void threadpool::exit() {
 void thread::idle_loop() {
   cmhi = cmh_data;
 
-  auto* p = calloc(sizeof(threadinfo), true);
-  if (p != nullptr) {
-    std::memset(p, 0, sizeof(threadinfo));
-    ti = new(p) threadinfo;
-  }
+  auto* p = ::operator new(sizeof(threadinfo),
+    std::align_val_t{ alignof(threadinfo) });
+  std::memset(p, 0, sizeof(threadinfo));
+  ti = new(p) threadinfo;
 
   root_position = &ti->root_position;
+#ifdef HOT_PROFILE
+  ti->profile = &thread_hot_profile;
+#endif
 
   while (!exit_) {
     std::unique_lock lk(mutex_);
@@ -87,10 +101,18 @@ void thread::idle_loop() {
 
     lk.unlock();
 
-    if (!exit_) begin_search();
+    if (!exit_) {
+#ifdef HOT_PROFILE
+      const auto start = __rdtsc();
+      begin_search();
+      ti->profile->search_cycles += __rdtsc() - start;
+#else
+      begin_search();
+#endif
+    }
   }
 
-  free(p);
+  ::operator delete(p, std::align_val_t{ alignof(threadinfo) });
 }
 
 void thread::wait(const std::atomic_bool& condition) {
@@ -115,6 +137,19 @@ void thread::wake(const bool activate_search) {
   sleep_condition_.notify_one();
 }
 
+void mainthread::adjust_poll_interval() {
+  constexpr auto min_poll_interval = 128;
+  constexpr auto max_poll_interval = 16384;
+
+  const auto time = now();
+  if (const auto delta = time - last_poll_time;
+    delta < 1 && poll_interval < max_poll_interval)
+    poll_interval *= 2;
+  else if (delta > 2 && poll_interval > min_poll_interval)
+    poll_interval /= 2;
+  last_poll_time = time;
+}
+
 uint64_t threadpool::visited_nodes() const {
   uint64_t nodes = 0;
   for (auto i = 0; i < active_thread_count; ++i)
@@ -122,4 +157,149 @@ uint64_t threadpool::visited_nodes() const {
   return nodes;
 }
 
+uint64_t threadpool::sort_work() const {
+  uint64_t work = 0;
+  for (auto i = 0; i < active_thread_count; ++i)
+    work += threads[i]->ti->sort_work;
+  return work;
+}
+
+void threadpool::request_stop() {
+  auto expected = static_cast<int64_t>(0);
+  stop_request_time.compare_exchange_strong(expected, now_micros());
+  search::signals.stop_analyzing = true;
+  main()->wake(false);
+}
+
+timerthread::timerthread() {
+  native_thread_ = std::thread(&timerthread::idle_loop, this);
+}
+
+timerthread::~timerthread() {
+  mutex_.lock();
+  exit_ = true;
+  sleep_condition_.notify_one();
+  mutex_.unlock();
+  native_thread_.join();
+}
+
+void timerthread::arm(const bool active) {
+  std::unique_lock lk(mutex_);
+  if (active) ++generation_;
+  armed_ = active;
+  // a ponderhit can arrive before the main thread arms the timer, so it is
+  // kept until the search ends
+  if (!active) ponder_hit_ = false;
+  sleep_condition_.notify_one();
+}
+
+void timerthread::ponder_hit() {
+  std::unique_lock lk(mutex_);
+  ponder_hit_ = true;
+  sleep_condition_.notify_one();
+}
+
+void timerthread::idle_loop() {
+  std::unique_lock lk(mutex_);
+
+  while (!exit_) {
+    // ponderhit is applied here, under the timer mutex, so the uci thread
+    // never writes the ponder flag or the time limits during a search
+    if (armed_ && ponder_hit_) {
+      ponder_hit_ = false;
+      search::param.ponder = 0;
+      search::adjust_time_after_ponder_hit();
+      if (search::signals.stop_if_ponder_hit) thread_pool.request_stop();
+    }
+
+    const auto deadline = armed_ ? search::hard_deadline() : 0;
+    if (!deadline) {
+      sleep_condition_.wait(lk);
+      continue;
+    }
+
+    // the deadline belongs to the search armed under this generation. a go
+    // that re-arms while the timer sleeps gets its deadline on the next pass
+    if (const auto generation = generation_;
+      deadline > time_control.elapsed()) {
+      sleep_condition_.wait_for(lk,
+        std::chrono::milliseconds(deadline - time_control.elapsed()));
+      if (generation != generation_ || !armed_ || ponder_hit_ ||
+        deadline > time_control.elapsed())
+        continue;
+    }
+
+    // raised under the lock, so no new arm can slip in before the stop
+    armed_ = false;
+    thread_pool.request_stop();
+  }
+}
+
+void latency_log::add(const int64_t micros) {
+  std::unique_lock lk(mutex_);
+  samples_[count_++ % max_samples] = micros;
+}
+
+void latency_log::report() {
+  std::unique_lock lk(mutex_);
+  const auto n = std::min(count_, max_samples);
+  if (!n) {
+    acout() << "info string stop latency no samples" << std::endl;
+    return;
+  }
+
+  int64_t sorted[max_samples];
+  std::copy_n(samples_, n, sorted);
+  std::sort(sorted, sorted + n);
+  acout() << "info string stop latency samples " << n << " p50 "
+    << sorted[n / 2] << " p99 " << sorted[(n * 99) / 100] << " max "
+    << sorted[n - 1] << " us" << std::endl;
+}
+
+// what each thread allocates, table by table. the history tables search
+// reads at every node are summed as the hot set, that is what should stay
+// in a core's L2
+void threadpool::report_memory() const {
+  struct table {
+    const char* name;
+    size_t bytes;
+    bool hot;
+  };
+  const table tables[] = {
+    {"position_inf", sizeof threadinfo::position_inf, false},
+    {"movepick_inf", sizeof threadinfo::movepick_inf, false},
+    {"pin_inf", sizeof threadinfo::pin_inf, false},
+#ifdef COPY_MAKE
+    {"board_stack", sizeof threadinfo::board_stack, false},
+#endif
+    {"move_list", sizeof threadinfo::move_list, false},
+    {"history", sizeof threadinfo::history, true},
+    {"evasion_history", sizeof threadinfo::evasion_history, true},
+    {"capture_history", sizeof threadinfo::capture_history, true},
+    {"max_gain_table", sizeof threadinfo::max_gain_table, true},
+    {"counter_moves", sizeof threadinfo::counter_moves, true},
+    {"counter_followup_moves", sizeof threadinfo::counter_followup_moves, true},
+  };
+
+  size_t hot = 0;
+  std::ostringstream ss;
+  ss << "threadinfo table              bytes" << std::endl;
+  for (const auto& t : tables) {
+    ss << std::left << std::setw(24) << t.name << std::right << std::setw(11)
+      << t.bytes << (t.hot ? " hot" : "") << std::endl;
+    if (t.hot) hot += t.bytes;
+  }
+  ss << std::left << std::setw(24) << "hot history" << std::right
+    << std::setw(11) << hot << std::endl;
+  ss << std::left << std::setw(24) << "threadinfo per thread" << std::right
+    << std::setw(11) << sizeof(threadinfo) << std::endl;
+  ss << std::left << std::setw(24) << "threads" << std::right << std::setw(11)
+    << thread_count << std::endl;
+  ss << std::left << std::setw(24) << "threadinfo all threads" << std::right
+    << std::setw(11) << sizeof(threadinfo) * thread_count << std::endl;
+  ss << std::left << std::setw(24) << "counter_move_stats" << std::right
+    << std::setw(11) << sizeof(cmhinfo) << " shared" << std::endl;
+  acout() << ss.str();
+}
+
 threadpool thread_pool;
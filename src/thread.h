@@ -4,10 +4,12 @@
 #include <mutex>
 #include <thread>
 #include <vector>
+#include "hash.h"
 #include "main.h"
 #include "movepick.h"
 #include "mutex.h"
 #include "position.h"
+#include "profile.h"
 #include "search.h"
 
 class thread {
@@ -24,10 +26,13 @@ public:
   void wake(bool activate_search);
   void wait_for_search_to_end();
   void wait(const std::atomic_bool& condition);
+  void init_search_stack() const;
 
   threadinfo* ti{};
   cmhinfo* cmhi{};
   position* root_position{};
+  hash* hash_table = &main_hash;
+  search_signals* signals = &search::signals;
 
   rootmoves root_moves;
   int completed_depth = no_depth;
@@ -38,16 +43,36 @@ struct cmhinfo {
   counter_move_history counter_move_stats;
 };
 
-struct threadinfo {
+// the stacks hold 5 plies of lead in, at most max_game_history plies of game
+// history (see position::trim_history) and max_ply search plies, the last
+// few read ahead at pi + 2. move_list takes the generated moves of every ply
+// on the current line
+constexpr int stack_plies = 5 + max_game_history + max_ply + 8;
+
+// allocated with 64-byte alignment (thread::idle_loop), so the per-ply
+// stacks start on a cache line
+struct alignas(64) threadinfo {
   position root_position{};
-  position_info position_inf[1024]{};
-  s_move move_list[8192]{};
+  position_info position_inf[stack_plies]{};
+  movepick_info movepick_inf[stack_plies]{};
+  pin_info pin_inf[stack_plies]{};
+#ifdef COPY_MAKE
+  board_state board_stack[stack_plies]{};
+#endif
+  s_move move_list[max_ply * 64]{};
   move_value_stats history{};
   move_value_stats evasion_history{};
   max_gain_stats max_gain_table;
   counter_move_stats counter_moves{};
   counter_follow_up_move_stats counter_followup_moves;
   move_value_stats capture_history{};
+  uint64_t sort_work{};
+#ifdef SEARCH_STATS
+  search_stats stats{};
+#endif
+#ifdef HOT_PROFILE
+  hot_profile* profile{};
+#endif
 };
 
 struct mainthread final : thread {
@@ -60,7 +85,34 @@ struct mainthread final : thread {
   int best_move_changed = 0;
   int previous_root_score = score_0;
   int interrupt_counter = 0;
+  int poll_interval = 1024;
+  time_point last_poll_time{};
   int previous_root_depth = {};
+  void adjust_poll_interval();
+};
+
+class timerthread {
+  std::thread native_thread_;
+  Mutex mutex_;
+  ConditionVariable sleep_condition_;
+  bool exit_ = false, armed_ = false, ponder_hit_ = false;
+  uint64_t generation_ = 0;
+public:
+  timerthread();
+  ~timerthread();
+  void idle_loop();
+  void arm(bool active);
+  void ponder_hit();
+};
+
+struct latency_log {
+  void add(int64_t micros);
+  void report();
+private:
+  static constexpr int max_samples = 1024;
+  Mutex mutex_;
+  int64_t samples_[max_samples]{};
+  int count_{};
 };
 
 struct threadpool : std::vector<thread*> {
@@ -79,6 +131,9 @@ struct threadpool : std::vector<thread*> {
   void begin_search(position&, const search_param&);
   void change_thread_count(int num_threads);
   [[nodiscard]] uint64_t visited_nodes() const;
+  [[nodiscard]] uint64_t sort_work() const;
+  void request_stop();
+  void report_memory() const;
   static void delete_counter_move_history();
 
   int active_thread_count{};
@@ -91,6 +146,9 @@ struct threadpool : std::vector<thread*> {
   bool analysis_mode{};
   int fifty_move_distance{};
   int multi_pv{}, multi_pv_max{};
+  timerthread* timer{};
+  std::atomic<int64_t> stop_request_time{};
+  latency_log stop_latency;
   bool dummy_null_move_threat{}, dummy_prob_cut{};
 };
 
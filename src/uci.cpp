@@ -1,7 +1,9 @@
 #include "uci.h"
+#include <charconv>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include "analyze.h"
 #include "bench.h"
 #include "bitboard.h"
 #include "evaluate.h"
@@ -29,7 +31,7 @@ int init_engine() {
   search::reset();
   main_hash.init(64);
   const char* filename = uci_nnue_evalfile.c_str();
-  return nnue_init(filename);
+  return nnue_init(filename, uci_shared_net);
 }
 
 int uci_loop(const int argc, char* argv[]) {
@@ -69,6 +71,10 @@ int uci_loop(const int argc, char* argv[]) {
       acout() << "option name Ponder type check default false" << std::endl;
       acout() << "option name UCI_Chess960 type check default false"
         << std::endl;
+      acout() << "option name EvalFile type string default "
+        << uci_nnue_evalfile << std::endl;
+      acout() << "option name SharedNet type check default false"
+        << std::endl;
       acout() << "uciok" << std::endl;
       ret = fflush(stdout);
     }
@@ -90,8 +96,10 @@ int uci_loop(const int argc, char* argv[]) {
     }
     else if (token == "stop" ||
       (token == "ponderhit" && search::signals.stop_if_ponder_hit)) {
-      search::signals.stop_analyzing = true;
-      thread_pool.main()->wake(false);
+      thread_pool.request_stop();
+    }
+    else if (token == "ponderhit") {
+      thread_pool.timer->ponder_hit();
     }
     else if (token == "quit") {
       break;
@@ -114,15 +122,106 @@ int uci_loop(const int argc, char* argv[]) {
       divide(depth, fen);
     }
     else if (token == "bench") {
-      auto bench_depth = is >> token ? token : "14";
+      bench_options opt;
+      opt.threads = uci_threads;
+      opt.hash = uci_hash;
+      auto valid = true;
+      while (valid && is >> token) {
+        if (token == "threads")
+          is >> opt.threads;
+        else if (token == "hash")
+          is >> opt.hash;
+        else if (token == "runs")
+          is >> opt.runs;
+        else if (token == "json")
+          opt.json = true;
+        else if (token == "perf")
+          opt.perf = true;
+        else {
+          // built without exceptions, so no stoi on user input
+          const auto* const last = token.data() + token.size();
+          const auto [ptr, ec] = std::from_chars(token.data(), last, opt.depth);
+          valid = ec == std::errc() && ptr == last && opt.depth > 0;
+          if (!valid)
+            acout() << "info string bench: unknown argument " << token
+            << std::endl;
+        }
+      }
+      if (valid) {
+        bench_active = true;
+        bench(opt);
+        bench_active = false;
+      }
+    }
+    else if (token == "scalebench") {
+      bench_options opt;
+      opt.depth = 12;
+      opt.threads = static_cast<int>(std::thread::hardware_concurrency());
+      opt.hash = uci_hash;
+      while (is >> token) {
+        if (token == "depth")
+          is >> opt.depth;
+        else if (token == "movetime")
+          is >> opt.move_time;
+        else if (token == "threads")
+          is >> opt.threads;
+        else if (token == "hash")
+          is >> opt.hash;
+      }
       bench_active = true;
-      bench(stoi(bench_depth));
+      scalebench(opt);
       bench_active = false;
     }
+    else if (token == "pgobench") {
+      bench_options opt;
+      opt.depth = 10;
+      opt.threads = 4;
+      opt.hash = uci_hash;
+      while (is >> token) {
+        if (token == "depth")
+          is >> opt.depth;
+        else if (token == "threads")
+          is >> opt.threads;
+        else if (token == "hash")
+          is >> opt.hash;
+      }
+      bench_active = true;
+      pgobench(opt);
+      bench_active = false;
+    }
+    else if (token == "nnuebench") {
+      auto reps = 200;
+      while (is >> token)
+        if (token == "reps") is >> reps;
+      nnuebench(std::max(reps, 1));
+    }
+    else if (token == "convertnet") {
+      std::string out_file;
+      is >> out_file;
+      nnue_convert(out_file.c_str());
+    }
+    else if (token == "nnuecheck") {
+      std::string eval_file, epd_file;
+      is >> eval_file >> epd_file;
+      nnuecheck(eval_file, epd_file);
+    }
+    else if (token == "analyze") {
+      analyze(is);
+    }
+    else if (token == "searchstats") {
+      search::print_stats();
+    }
+    else if (token == "memory") {
+      thread_pool.report_memory();
+    }
+    else if (token == "stoplatency") {
+      thread_pool.stop_latency.report();
+    }
     else {
     }
   } while (token != "quit" && argc == 1);
   thread_pool.exit();
+  nnue_exit();
   return ret;
 }
 
@@ -196,6 +295,21 @@ int set_option(std::istringstream& is) {
         acout() << "info string UCI_Chess960 " << uci_chess960 << std::endl;
         break;
       }
+      if (token == "SharedNet") {
+        is >> token;
+        is >> token;
+        uci_shared_net = token == "true";
+        acout() << "info string SharedNet " << uci_shared_net << std::endl;
+        nnue_load(uci_nnue_evalfile, uci_shared_net);
+        break;
+      }
+      if (token == "EvalFile") {
+        is >> token;
+        std::getline(is >> std::ws, token);
+        uci_nnue_evalfile = trim(token);
+        nnue_load(uci_nnue_evalfile, uci_shared_net);
+        break;
+      }
     }
     ret = fflush(stdout);
   }
@@ -242,6 +356,8 @@ void go(position& pos, std::istringstream& is) {
     }
     else if (token == "infinite")
       param.infinite = 1;
+    else if (token == "ponder")
+      param.ponder = 1;
   }
   thread_pool.begin_search(pos, param);
 }
@@ -266,6 +382,7 @@ void set_position(position& pos, std::istringstream& is) {
   while (is >> token && (move = move_from_string(pos, token)) != no_move) {
     pos.play_move(move);
     pos.increase_game_ply();
+    pos.trim_history();
   }
 }
 
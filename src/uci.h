@@ -10,6 +10,7 @@ inline int uci_multipv = 1;
 inline int uci_contempt = 0;
 inline bool uci_ponder = false;
 inline bool uci_chess960 = false;
+inline bool uci_shared_net = false;
 inline bool bench_active = false;
 int init_engine();
 void new_game();
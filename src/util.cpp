@@ -95,5 +95,88 @@ void build_info() {
   date >> month >> day >> year;
   bi << month << ' ' << std::setw(2) << std::setfill('0') << day << ' ' << year
     << ' ' << std::setw(2) << std::setfill('0') << __TIME__ << '\n';
+  bi << "position_info " << sizeof(position_info) << " bytes ("
+    << (sizeof(position_info) + 63) / 64 << " cache lines) movepick_info "
+    << sizeof(movepick_info) << " pin_info " << sizeof(pin_info) << '\n';
+  bi << "isa " << isa_level()
+#if defined(FAT_BINARY)
+    << " (fat)"
+#endif
+    << '\n';
   acout() << bi.str();
 }
+
+// the instruction set level the hot kernels run at. a fat binary asks the
+// same question its ifunc resolvers do, other builds report what they were
+// compiled for
+const char* isa_level() {
+#if defined(FAT_BINARY)
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("x86-64-v4") ? "x86-64-v4" : "x86-64-v3";
+#elif defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512VL__)
+  return "x86-64-v4";
+#elif defined(__AVX2__) && defined(__BMI2__)
+  return "x86-64-v3";
+#elif defined(__AVX2__) || defined(USE_AVX2)
+  return "avx2";
+#else
+  return "x86-64-v2";
+#endif
+}
+
+outputqueue::outputqueue() {
+  native_thread_ = std::thread(&outputqueue::idle_loop, this);
+}
+
+outputqueue::~outputqueue() {
+  exit_ = true;
+  pushed_.fetch_add(1);
+  pushed_.notify_one();
+  native_thread_.join();
+}
+
+void outputqueue::push(std::string&& text) {
+  if (text.empty()) return;
+  auto* n = new node{head_.load(std::memory_order_relaxed), std::move(text)};
+  while (!head_.compare_exchange_weak(n->next, n, std::memory_order_release,
+    std::memory_order_relaxed)) {
+  }
+  pushed_.fetch_add(1, std::memory_order_release);
+  pushed_.notify_one();
+}
+
+void outputqueue::drain() {
+  auto* n = head_.exchange(nullptr, std::memory_order_acquire);
+  if (!n) return;
+
+  // the stack holds the newest line first, reverse it into push order
+  node* list = nullptr;
+  while (n) {
+    auto* next = n->next;
+    n->next = list;
+    list = n;
+    n = next;
+  }
+
+  while (list) {
+    std::cout << list->text;
+    const auto* done = list;
+    list = list->next;
+    delete done;
+  }
+  std::cout.flush();
+}
+
+void outputqueue::idle_loop() {
+  for (;;) {
+    const auto seen = pushed_.load(std::memory_order_acquire);
+    drain();
+    if (exit_) {
+      drain();
+      return;
+    }
+    pushed_.wait(seen, std::memory_order_acquire);
+  }
+}
+
+outputqueue output_queue;
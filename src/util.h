@@ -1,23 +1,46 @@
 #pragma once
+#include <atomic>
 #include <iostream>
-#include <mutex>
-#include <random>
+#include <sstream>
+#include <thread>
 #include "position.h"
 
-static std::mutex mutex_cout;
+// lock-free output queue: any thread pushes finished lines, a dedicated
+// writer thread drains them in order and flushes once per batch
+class outputqueue {
+  struct node {
+    node* next;
+    std::string text;
+  };
+  std::atomic<node*> head_{};
+  std::atomic<uint64_t> pushed_{};
+  std::atomic_bool exit_{};
+  std::thread native_thread_;
+  void idle_loop();
+  void drain();
+public:
+  outputqueue();
+  ~outputqueue();
+  void push(std::string&& text);
+};
+
+extern outputqueue output_queue;
 
 struct acout {
-  std::unique_lock<std::mutex> lk;
-  acout() : lk(std::unique_lock(mutex_cout)) {}
+  std::ostringstream ss;
+  acout() = default;
+  acout(const acout&) = delete;
+  acout& operator=(const acout&) = delete;
+  ~acout() { output_queue.push(std::move(ss).str()); }
 
   template <typename T>
   acout& operator<<(const T& t) {
-    std::cout << t;
+    ss << t;
     return *this;
   }
 
   acout& operator<<(std::ostream& (*fp)(std::ostream&)) {
-    std::cout << fp;
+    ss << fp;
     return *this;
   }
 };
@@ -26,25 +49,28 @@ const std::string piece_to_char(" KPNBRQ  kpnbrq");
 std::string move_to_string(uint32_t move, const position& pos);
 uint32_t move_from_string(const position& pos, std::string& str);
 
-class random {
-  static uint64_t rand64() {
-    std::random_device rd;
-    std::mt19937_64 gen(rd());
-    std::uniform_int_distribution<uint64_t> dis;
-    return dis(gen);
+// xorshift64* generator: a fixed seed gives the same zobrist keys, and so
+// the same bench node counts, on every run
+class prng {
+  uint64_t rand64() {
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    return s * 2685821657736338717ULL;
   }
 public:
   uint64_t s;
 
-  explicit random(const uint64_t seed) : s(seed) {
+  explicit prng(const uint64_t seed) : s(seed) {
     assert(seed);
   }
 
   template <typename T>
-  static T rand() {
+  T rand() {
     return T(rand64());
   }
 };
 void engine_info();
 void build_info();
+const char* isa_level();
 std::ostream& operator<<(std::ostream& os, const position& pos);